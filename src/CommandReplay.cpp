@@ -0,0 +1,153 @@
+#include "CommandReplay.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+
+CommandReplay::CommandReplay(cl_command_queue queue, bool allowCommandBuffer)
+    : queue(queue), allowCommandBuffer(allowCommandBuffer) {
+    if (allowCommandBuffer && !loadCommandBufferFunctions()) {
+        this->allowCommandBuffer = false;
+    }
+}
+
+CommandReplay::~CommandReplay() {
+    clear();
+}
+
+// Checks that the device of the queue exposes cl_khr_command_buffer and
+// resolves its entry points
+bool CommandReplay::loadCommandBufferFunctions() {
+    cl_device_id device;
+    cl_platform_id platform;
+    if (clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, nullptr) != CL_SUCCESS
+        || clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, nullptr) != CL_SUCCESS) {
+        return false;
+    }
+
+    size_t size = 0;
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, nullptr, &size);
+    std::string extensions(size, '\0');
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, size, &extensions[0], nullptr);
+    std::istringstream extensionStream(extensions.c_str());
+    std::string extension;
+    bool supported = false;
+    while (extensionStream >> extension) {
+        supported |= extension == "cl_khr_command_buffer";
+    }
+    if (!supported) {
+        return false;
+    }
+
+    createCommandBuffer = (clCreateCommandBufferKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clCreateCommandBufferKHR");
+    commandNDRangeKernel = (clCommandNDRangeKernelKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clCommandNDRangeKernelKHR");
+    finalizeCommandBuffer = (clFinalizeCommandBufferKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clFinalizeCommandBufferKHR");
+    enqueueCommandBuffer = (clEnqueueCommandBufferKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clEnqueueCommandBufferKHR");
+    releaseCommandBuffer = (clReleaseCommandBufferKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clReleaseCommandBufferKHR");
+    return createCommandBuffer && commandNDRangeKernel && finalizeCommandBuffer && enqueueCommandBuffer && releaseCommandBuffer;
+}
+
+void CommandReplay::clear() {
+    if (commandBuffer) {
+        releaseCommandBuffer(commandBuffer);
+        commandBuffer = nullptr;
+    }
+    launches.clear();
+    finalized = false;
+}
+
+bool CommandReplay::addLaunch(cl_kernel kernel, cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize) {
+    if (finalized || workDim < 1 || workDim > 3) {
+        std::cerr << "Failed to record kernel launch" << std::endl;
+        return false;
+    }
+    Launch launch = { kernel, workDim, { 1, 1, 1 }, { 1, 1, 1 }, localWorkSize != nullptr };
+    for (cl_uint i = 0; i < workDim; ++i) {
+        launch.globalWorkSize[i] = globalWorkSize[i];
+        if (localWorkSize) {
+            launch.localWorkSize[i] = localWorkSize[i];
+        }
+    }
+    launches.push_back(launch);
+    return true;
+}
+
+bool CommandReplay::addStageMarker() {
+    if (finalized) {
+        std::cerr << "Failed to record stage marker" << std::endl;
+        return false;
+    }
+    launches.push_back({ nullptr, 0, { 0, 0, 0 }, { 0, 0, 0 }, false });
+    return true;
+}
+
+bool CommandReplay::finalize() {
+    finalized = true;
+    if (!allowCommandBuffer) {
+        return true;
+    }
+
+    cl_int err;
+    commandBuffer = createCommandBuffer(1, &queue, nullptr, &err);
+    if (err != CL_SUCCESS || !commandBuffer) {
+        std::cerr << "Failed to create command buffer, falling back to launch list" << std::endl;
+        commandBuffer = nullptr;
+        allowCommandBuffer = false;
+        return true;
+    }
+    for (const Launch& launch : launches) {
+        if (!launch.kernel) continue;
+        err = commandNDRangeKernel(commandBuffer, nullptr, nullptr, launch.kernel, launch.workDim, nullptr,
+            launch.globalWorkSize, launch.hasLocalWorkSize ? launch.localWorkSize : nullptr, 0, nullptr, nullptr, nullptr);
+        if (err != CL_SUCCESS) break;
+    }
+    if (err == CL_SUCCESS) {
+        err = finalizeCommandBuffer(commandBuffer);
+    }
+    if (err != CL_SUCCESS) {
+        std::cerr << "Failed to record command buffer (" << err << "), falling back to launch list" << std::endl;
+        releaseCommandBuffer(commandBuffer);
+        commandBuffer = nullptr;
+        allowCommandBuffer = false;
+    }
+    return true;
+}
+
+bool CommandReplay::replay(std::vector<cl_event>* stageEvents) {
+    if (!finalized) {
+        std::cerr << "Command replay is not finalized" << std::endl;
+        return false;
+    }
+
+    cl_int err;
+    if (commandBuffer) {
+        err = enqueueCommandBuffer(0, nullptr, commandBuffer, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            std::cerr << "Failed to enqueue command buffer " << err << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // In-order queue: no need to wait between dependent launches
+    for (const Launch& launch : launches) {
+        if (!launch.kernel) {
+            if (stageEvents) {
+                cl_event event = nullptr;
+                err = clEnqueueMarkerWithWaitList(queue, 0, nullptr, &event);
+                if (err != CL_SUCCESS) {
+                    std::cerr << "Failed to enqueue marker " << err << std::endl;
+                    return false;
+                }
+                stageEvents->push_back(event);
+            }
+            continue;
+        }
+        err = clEnqueueNDRangeKernel(queue, launch.kernel, launch.workDim, nullptr, launch.globalWorkSize,
+            launch.hasLocalWorkSize ? launch.localWorkSize : nullptr, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            std::cerr << "Failed to enqueue kernel " << err << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
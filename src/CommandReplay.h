@@ -0,0 +1,73 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <vector>
+
+// Minimal declarations of the provisional cl_khr_command_buffer extension,
+// which is not part of the bundled OpenCL 1.2 headers.
+#ifndef cl_khr_command_buffer
+#define cl_khr_command_buffer 1
+typedef struct _cl_command_buffer_khr* cl_command_buffer_khr;
+typedef struct _cl_mutable_command_khr* cl_mutable_command_khr;
+typedef cl_uint cl_sync_point_khr;
+typedef cl_ulong cl_command_buffer_properties_khr;
+typedef cl_ulong cl_ndrange_kernel_command_properties_khr;
+#endif
+
+// Sequence of kernel launches recorded once per configuration and replayed
+// every frame on an in-order queue, without argument setup nor intermediate
+// clFinish. When the device supports cl_khr_command_buffer, the sequence is
+// finalized into a command buffer, which captures the kernel arguments at
+// recording time: it must be recorded again when any argument changes.
+// Otherwise the launches are replayed from a prevalidated list and pick up
+// the current arguments of their kernels.
+class CommandReplay {
+public:
+    CommandReplay(cl_command_queue queue, bool allowCommandBuffer = true);
+    ~CommandReplay();
+
+    void clear();
+    bool addLaunch(cl_kernel kernel, cl_uint workDim, const size_t* globalWorkSize, const size_t* localWorkSize);
+    // Marks the end of a stage. When replaying the launch list, a marker event
+    // is returned for each stage so that stages can be profiled. Markers are
+    // ignored by command buffers.
+    bool addStageMarker();
+    bool finalize();
+    bool replay(std::vector<cl_event>* stageEvents = nullptr);
+
+    bool isFinalized() const { return finalized; }
+    bool usesCommandBuffer() const { return commandBuffer != nullptr; }
+
+private:
+    struct Launch {
+        cl_kernel kernel;  // nullptr for a stage marker
+        cl_uint workDim;
+        size_t globalWorkSize[3];
+        size_t localWorkSize[3];
+        bool hasLocalWorkSize;
+    };
+
+    bool loadCommandBufferFunctions();
+
+    cl_command_queue queue;
+    bool allowCommandBuffer;
+    bool finalized = false;
+    std::vector<Launch> launches;
+    cl_command_buffer_khr commandBuffer = nullptr;
+
+    typedef cl_command_buffer_khr (CL_API_CALL *clCreateCommandBufferKHR_fn)(cl_uint, const cl_command_queue*,
+        const cl_command_buffer_properties_khr*, cl_int*);
+    typedef cl_int (CL_API_CALL *clCommandNDRangeKernelKHR_fn)(cl_command_buffer_khr, cl_command_queue,
+        const cl_ndrange_kernel_command_properties_khr*, cl_kernel, cl_uint, const size_t*, const size_t*,
+        const size_t*, cl_uint, const cl_sync_point_khr*, cl_sync_point_khr*, cl_mutable_command_khr*);
+    typedef cl_int (CL_API_CALL *clFinalizeCommandBufferKHR_fn)(cl_command_buffer_khr);
+    typedef cl_int (CL_API_CALL *clEnqueueCommandBufferKHR_fn)(cl_uint, cl_command_queue*, cl_command_buffer_khr,
+        cl_uint, const cl_event*, cl_event*);
+    typedef cl_int (CL_API_CALL *clReleaseCommandBufferKHR_fn)(cl_command_buffer_khr);
+
+    clCreateCommandBufferKHR_fn createCommandBuffer = nullptr;
+    clCommandNDRangeKernelKHR_fn commandNDRangeKernel = nullptr;
+    clFinalizeCommandBufferKHR_fn finalizeCommandBuffer = nullptr;
+    clEnqueueCommandBufferKHR_fn enqueueCommandBuffer = nullptr;
+    clReleaseCommandBufferKHR_fn releaseCommandBuffer = nullptr;
+};
@@ -0,0 +1,144 @@
+#include "LatencyGovernor.h"
+#include <algorithm>
+
+// Relative amount of work of each stage for a level (arbitrary unit)
+struct StageWork {
+    double pixels;
+    double cost;
+    double aggregation;
+    double disparity;
+};
+
+static StageWork stageWork(const QualityLevel& level) {
+    double pixels = 1.0 / (level.downscale * level.downscale);
+    double disparities = std::max(1, level.maxDisparity / level.downscale);
+    double window = (2.0 * level.halfWindowSize + 1.0) * (2.0 * level.halfWindowSize + 1.0);
+    return {
+        pixels,
+        pixels * disparities * window,
+        pixels * disparities * level.aggregationPaths,
+        pixels * disparities
+    };
+}
+
+static double scaled(double ms, double from, double to) {
+    return from > 0.0 ? ms * to / from : ms;
+}
+
+LatencyGovernor::LatencyGovernor(const LatencyGovernorSettings& settings, const std::vector<QualityLevel>& levels)
+    : settings(settings), levels(levels.empty() ? defaultLevels() : levels) {
+    estimates.resize(this->levels.size());
+}
+
+std::vector<QualityLevel> LatencyGovernor::defaultLevels() {
+    // halfWindowSize, maxDisparity, downscale, aggregationPaths
+    return {
+        { 3, 64, 1, 1 },
+        { 2, 64, 1, 1 },
+        { 2, 48, 1, 1 },
+        { 1, 48, 1, 1 },
+        { 2, 64, 2, 1 },
+        { 1, 64, 2, 1 },
+        { 1, 64, 2, 0 },
+    };
+}
+
+void LatencyGovernor::apply(StereoMatcherParameters& parameters) const {
+    const QualityLevel& level = levels[levelIndex];
+    parameters.halfWindowSize = level.halfWindowSize;
+    parameters.maxDisparity = level.maxDisparity;
+    parameters.downscale = level.downscale;
+    parameters.aggregationPaths = level.aggregationPaths;
+}
+
+void LatencyGovernor::update(const StereoFrameTimings& timings) {
+    frameCount++;
+
+    Estimate& estimate = estimates[levelIndex];
+    double alpha = estimate.samples == 0 ? 1.0 : settings.smoothing;
+    auto smooth = [alpha](double& average, double value) { average += alpha * (value - average); };
+    smooth(estimate.timings.uploadMs, timings.uploadMs);
+    smooth(estimate.timings.costMs, timings.costMs);
+    smooth(estimate.timings.aggregationMs, timings.aggregationMs);
+    smooth(estimate.timings.disparityMs, timings.disparityMs);
+    smooth(estimate.timings.computeMs, timings.computeMs);
+    smooth(estimate.timings.readbackMs, timings.readbackMs);
+    smooth(estimate.timings.totalMs, timings.totalMs);
+    estimate.timings.deviceTimings = timings.deviceTimings;
+    estimate.timings.stageBreakdown = timings.stageBreakdown;
+    estimate.samples++;
+    estimate.lastFrame = frameCount;
+
+    if (timings.totalMs > settings.budgetMs) {
+        deadlineMissCount++;
+        consecutiveMisses++;
+        consecutiveFastFrames = 0;
+    }
+    else {
+        consecutiveMisses = 0;
+        if (timings.totalMs < settings.budgetMs * settings.upgradeRatio) {
+            consecutiveFastFrames++;
+        }
+        else {
+            consecutiveFastFrames = 0;
+        }
+    }
+
+    if (consecutiveMisses >= settings.missesBeforeDowngrade && levelIndex + 1 < (int)levels.size()) {
+        changeLevel(levelIndex + 1);
+    }
+    else if (consecutiveFastFrames >= settings.framesBeforeUpgrade && levelIndex > 0) {
+        consecutiveFastFrames = 0;
+        if (predictFrameMs(levelIndex - 1) <= settings.budgetMs) {
+            changeLevel(levelIndex - 1);
+        }
+    }
+}
+
+void LatencyGovernor::changeLevel(int newIndex) {
+    levelIndex = newIndex;
+    levelChangeCount++;
+    consecutiveMisses = 0;
+    consecutiveFastFrames = 0;
+}
+
+double LatencyGovernor::predictFrameMs(int targetIndex) const {
+    const Estimate& target = estimates[targetIndex];
+    const Estimate& current = estimates[levelIndex];
+    StageWork from = stageWork(levels[levelIndex]);
+    StageWork to = stageWork(levels[targetIndex]);
+    const StereoFrameTimings& t = current.timings;
+
+    double predicted;
+    if (t.stageBreakdown) {
+        double stages = t.uploadMs + t.costMs + t.aggregationMs + t.disparityMs + t.readbackMs;
+        double fixedMs = std::max(0.0, t.totalMs - stages);
+        // a stage which is not run at the current level (no aggregation) is
+        // predicted from the cheapest matching stage
+        double aggregationMs = from.aggregation > 0.0 ? scaled(t.aggregationMs, from.aggregation, to.aggregation)
+            : scaled(t.disparityMs, from.disparity, to.aggregation);
+        predicted = fixedMs
+            + scaled(t.uploadMs, from.pixels, to.pixels)
+            + scaled(t.costMs, from.cost, to.cost)
+            + aggregationMs
+            + scaled(t.disparityMs, from.disparity, to.disparity)
+            + scaled(t.readbackMs, from.pixels, to.pixels);
+    }
+    else {
+        // without the breakdown, the whole compute time follows the cost stage,
+        // which dominates. Without device timings, it also holds the upload.
+        double computeMs = t.deviceTimings ? t.computeMs : std::max(0.0, t.totalMs - t.readbackMs);
+        double fixedMs = std::max(0.0, t.totalMs - computeMs - t.readbackMs);
+        predicted = fixedMs
+            + scaled(computeMs, from.cost, to.cost)
+            + scaled(t.readbackMs, from.pixels, to.pixels);
+    }
+
+    // a level measured recently is not expected to be faster than it was, so
+    // that a level we just stepped down from is not retried eagerly
+    uint64_t recentFrames = 10 * (uint64_t)settings.framesBeforeUpgrade;
+    if (target.samples > 0 && frameCount - target.lastFrame < recentFrames) {
+        predicted = std::max(predicted, target.timings.totalMs);
+    }
+    return predicted;
+}
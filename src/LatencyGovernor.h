@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "StereoMatcher.h"
+
+// Matcher settings traded against frame time by the LatencyGovernor
+struct QualityLevel {
+    int halfWindowSize;
+    int maxDisparity;       // full resolution pixels
+    int downscale;
+    int aggregationPaths;   // 0 or 1, see StereoMatcherParameters
+};
+
+struct LatencyGovernorSettings {
+    double budgetMs = 33.0;
+    // A level is stepped down after this many consecutive deadline misses
+    int missesBeforeDowngrade = 2;
+    // ... and stepped up after this many consecutive frames below
+    // upgradeRatio * budget, if the better level is predicted to take at most
+    // budgetMs (the streak already provides the hysteresis)
+    int framesBeforeUpgrade = 30;
+    double upgradeRatio = 0.7;
+    // Weight of the last frame in the moving averages of the timings
+    double smoothing = 0.2;
+};
+
+// Picks a quality level for every frame so that the measured frame time stays
+// within a latency budget. Levels go from the best quality (index 0) to the
+// fastest one. Stepping down reacts to repeated deadline misses, while stepping
+// up requires a sustained headroom and a prediction, built on the per-stage
+// timings of the current level, that the better level fits in the budget.
+class LatencyGovernor {
+public:
+    LatencyGovernor(const LatencyGovernorSettings& settings = LatencyGovernorSettings(),
+        const std::vector<QualityLevel>& levels = defaultLevels());
+
+    static std::vector<QualityLevel> defaultLevels();
+
+    // Writes the settings of the current level into parameters
+    void apply(StereoMatcherParameters& parameters) const;
+    // Reports the timings of a frame computed with the current level and
+    // selects the level of the next frame
+    void update(const StereoFrameTimings& timings);
+
+    void setBudget(double budgetMs) { settings.budgetMs = budgetMs; }
+    double getBudget() const { return settings.budgetMs; }
+    int getLevelIndex() const { return levelIndex; }
+    const QualityLevel& getLevel() const { return levels[levelIndex]; }
+    size_t getLevelCount() const { return levels.size(); }
+    // Moving average of the frame time at the current level
+    double getAverageFrameMs() const { return estimates[levelIndex].timings.totalMs; }
+
+    uint64_t getFrameCount() const { return frameCount; }
+    uint64_t getDeadlineMissCount() const { return deadlineMissCount; }
+    int getConsecutiveMissCount() const { return consecutiveMisses; }
+    uint64_t getLevelChangeCount() const { return levelChangeCount; }
+
+private:
+    struct Estimate {
+        StereoFrameTimings timings;  // moving averages
+        int samples = 0;
+        uint64_t lastFrame = 0;      // frame of the last sample
+    };
+
+    double predictFrameMs(int targetIndex) const;
+    void changeLevel(int newIndex);
+
+    LatencyGovernorSettings settings;
+    std::vector<QualityLevel> levels;
+    std::vector<Estimate> estimates;
+    int levelIndex = 0;
+
+    uint64_t frameCount = 0;
+    uint64_t deadlineMissCount = 0;
+    uint64_t levelChangeCount = 0;
+    int consecutiveMisses = 0;
+    int consecutiveFastFrames = 0;
+};
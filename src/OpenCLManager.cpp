@@ -48,5 +48,12 @@ bool OpenCLManager::createContextAndQueue() {
     return true;
 }
 
-
-
+cl_command_queue OpenCLManager::createCommandQueue(cl_command_queue_properties properties) const {
+    cl_int err;
+    cl_command_queue queue = clCreateCommandQueue(context, device, properties, &err);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Failed to create command queue" << std::endl;
+        return nullptr;
+    }
+    return queue;
+}
@@ -13,6 +13,9 @@ public:
     cl_command_queue getCommandQueue() const { return commandQueue; }
     cl_context getContext() const { return context; }
     cl_device_id getDevice() const { return device; }
+    // Creates an additional command queue on the same context and device.
+    // The caller owns the returned queue (nullptr on failure).
+    cl_command_queue createCommandQueue(cl_command_queue_properties properties = 0) const;
 
 private:
     cl_platform_id platform;
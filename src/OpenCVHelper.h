@@ -3,7 +3,18 @@
 #include <CL/cl.h>
 #include <opencv2/opencv.hpp>
 
-cl_mem createCostsOpenCLBuffer(size_t bufferSize, cl_context context, cl_command_queue queue)
+inline cl_mem createOpenCLBuffer(size_t bufferSize, cl_mem_flags flags, cl_context context)
+{
+    cl_int err;
+    cl_mem buffer = clCreateBuffer(context, flags, bufferSize, nullptr, &err);
+    if (err != CL_SUCCESS || buffer == nullptr) {
+        std::cerr << "Error: Failed to create OpenCL buffer! (Error code: " << err << ")" << std::endl;
+        return nullptr;
+    }
+    return buffer;
+}
+
+inline cl_mem createCostsOpenCLBuffer(size_t bufferSize, cl_context context, cl_command_queue queue)
 {
     cl_int err;
     cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * sizeof(float), nullptr, &err);
@@ -15,7 +26,7 @@ cl_mem createCostsOpenCLBuffer(size_t bufferSize, cl_context context, cl_command
     return buffer;
 }
 
-cl_mem createOpenCLBufferFromMat(const cv::Mat& mat, cl_context context, cl_command_queue queue, bool write) {
+inline cl_mem createOpenCLBufferFromMat(const cv::Mat& mat, cl_context context, cl_command_queue queue, bool write) {
     if (mat.empty()) {
         std::cerr << "Error: Input cv::Mat is empty!" << std::endl;
         return nullptr;
@@ -25,7 +36,7 @@ cl_mem createOpenCLBufferFromMat(const cv::Mat& mat, cl_context context, cl_comm
      
     cl_int err;
     cl_mem buffer = nullptr;
-	cl_mem_flags flags = write ? CL_MEM_WRITE_ONLY: (CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR );
+	cl_mem_flags flags = write ? CL_MEM_READ_WRITE: (CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR );
 	uchar* data = write ? nullptr : mat.data;
     // Handle the type based on whether it's an input (e.g., grayscale 8-bit) or output (e.g., disparity map, unsigned short)
     if (mat.depth() == CV_8U) {
@@ -49,16 +60,16 @@ cl_mem createOpenCLBufferFromMat(const cv::Mat& mat, cl_context context, cl_comm
     return  buffer;
 }
 
-void fillMatFromOpenCLBuffer(cv::Mat& mat, cl_mem buffer, cl_context context, cl_command_queue queue) {
+inline bool fillMatFromOpenCLBuffer(cv::Mat& mat, cl_mem buffer, cl_context context, cl_command_queue queue) {
     // Check if the input cv::Mat is empty, or the OpenCL buffer is null
     if (mat.empty()) {
         std::cerr << "Error: Output cv::Mat is empty!" << std::endl;
-        return;
+        return false;
     }
 
     if (buffer == nullptr) {
         std::cerr << "Error: Input OpenCL buffer is null!" << std::endl;
-        return;
+        return false;
     }
 
     // Read the buffer data into the cv::Mat
@@ -66,13 +77,78 @@ void fillMatFromOpenCLBuffer(cv::Mat& mat, cl_mem buffer, cl_context context, cl
         mat.data, 0, nullptr, nullptr);
     if (err != CL_SUCCESS) {
         std::cerr << "Error: Failed to read OpenCL buffer into cv::Mat!" << std::endl;
-        return;
+        return false;
     }
 
     // Wait for the reading operation to finish (blocking read)
     err = clFinish(queue);
     if (err != CL_SUCCESS) {
         std::cerr << "Error: Failed to finish OpenCL buffer read operation!" << std::endl;
-        return;
+        return false;
+    }
+    return true;
+}
+
+// Point buffer for ReprojectTo3DKernel (one float4 per pixel at most). Allocated in
+// host-visible memory so that the compacted points can be mapped instead of copied.
+inline cl_mem createPointCloudOpenCLBuffer(size_t maxPoints, cl_context context)
+{
+    cl_int err;
+    cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, maxPoints * sizeof(cl_float4), nullptr, &err);
+    if (err != CL_SUCCESS || buffer == nullptr) {
+        std::cerr << "Error: Failed to create OpenCL point buffer! (Error code: " << err << ")" << std::endl;
+        return nullptr;
+    }
+    return buffer;
+}
+
+inline cl_mem createPointCounterOpenCLBuffer(cl_context context)
+{
+    cl_int err;
+    cl_uint zero = 0;
+    cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint), &zero, &err);
+    if (err != CL_SUCCESS || buffer == nullptr) {
+        std::cerr << "Error: Failed to create OpenCL counter buffer! (Error code: " << err << ")" << std::endl;
+        return nullptr;
+    }
+    return buffer;
+}
+
+// Copies the packed points written by ReprojectTo3DKernel in compact mode into
+// points (N x 1, CV_32FC4: x, y, z, intensity). Only the first N points of the
+// buffer are mapped, N being the value of the counter.
+inline bool fillPointCloudFromOpenCLBuffer(cv::Mat& points, cl_mem pointBuffer, cl_mem pointCounterBuffer, cl_command_queue queue) {
+    if (pointBuffer == nullptr || pointCounterBuffer == nullptr) {
+        std::cerr << "Error: Input OpenCL buffer is null!" << std::endl;
+        return false;
+    }
+
+    cl_uint pointCount = 0;
+    cl_int err = clEnqueueReadBuffer(queue, pointCounterBuffer, CL_TRUE, 0, sizeof(pointCount),
+        &pointCount, 0, nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Error: Failed to read point counter!" << std::endl;
+        return false;
+    }
+
+    points.create((int)pointCount, 1, CV_32FC4);
+    if (pointCount == 0) {
+        return true;
+    }
+
+    size_t mappedSize = pointCount * sizeof(cl_float4);
+    void* mapped = clEnqueueMapBuffer(queue, pointBuffer, CL_TRUE, CL_MAP_READ, 0, mappedSize,
+        0, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS || mapped == nullptr) {
+        std::cerr << "Error: Failed to map OpenCL point buffer! (Error code: " << err << ")" << std::endl;
+        return false;
     }
-}
\ No newline at end of file
+    memcpy(points.data, mapped, mappedSize);
+
+    err = clEnqueueUnmapMemObject(queue, pointBuffer, mapped, 0, nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Error: Failed to unmap OpenCL point buffer!" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,372 @@
+#include "StereoMatcher.h"
+#include <algorithm>
+#include <chrono>
+#include "OpenCVHelper.h"
+#include "CommandReplay.h"
+#include "cppkernels/SADCostKernel.h"
+#include "cppkernels/HorizontalAggregationKernel.h"
+#include "cppkernels/ComputeBestDisparityKernel.h"
+#include "cppkernels/ReprojectTo3DKernel.h"
+
+class StereoMatcher::Stream {
+public:
+    Stream(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, int width, int height, const StereoStreamOptions& options) :
+        manager(manager),
+        program(std::move(program)),
+        width(width),
+        height(height),
+        maxDisparity(options.maxDisparity),
+        options(options) {
+    }
+
+    ~Stream() {
+        // kernels may still be referenced by pending commands
+        if (queue) clFinish(queue);
+        replay.reset();
+        costKernel.reset();
+        horizontalAggregationKernel.reset();
+        bestDisparityKernel.reset();
+        reprojectKernel.reset();
+        for (cl_mem buffer : { leftBuffer, rightBuffer, costBuffer, aggregatedBuffer, disparityBuffer, pointBuffer, pointCounterBuffer }) {
+            if (buffer) clReleaseMemObject(buffer);
+        }
+        if (ownsQueue && queue) clReleaseCommandQueue(queue);
+    }
+
+    bool initialize() {
+        if (options.dedicatedQueue) {
+            queue = manager.createCommandQueue(options.profiling ? CL_QUEUE_PROFILING_ENABLE : 0);
+            ownsQueue = queue != nullptr;
+            if (!queue) return false;
+        }
+        else {
+            queue = manager.getCommandQueue();
+        }
+
+        cl_context context = manager.getContext();
+        size_t pixels = (size_t)width * height;
+        leftBuffer = createOpenCLBuffer(pixels, CL_MEM_READ_ONLY, context);
+        rightBuffer = createOpenCLBuffer(pixels, CL_MEM_READ_ONLY, context);
+        costBuffer = createCostsOpenCLBuffer(pixels * maxDisparity, context, queue);
+        aggregatedBuffer = createCostsOpenCLBuffer(pixels * maxDisparity, context, queue);
+        disparityBuffer = createOpenCLBuffer(pixels * sizeof(cl_ushort), CL_MEM_READ_WRITE, context);
+        pointBuffer = createPointCloudOpenCLBuffer(pixels, context);
+        pointCounterBuffer = createPointCounterOpenCLBuffer(context);
+        if (!leftBuffer || !rightBuffer || !costBuffer || !aggregatedBuffer || !disparityBuffer || !pointBuffer || !pointCounterBuffer) {
+            return false;
+        }
+
+        costKernel = std::make_unique<SADCostKernel>(manager, program, queue);
+        horizontalAggregationKernel = std::make_unique<HorizontalAggregationKernel>(manager, program, queue);
+        bestDisparityKernel = std::make_unique<ComputeBestDisparityKernel>(manager, program, queue);
+        reprojectKernel = std::make_unique<ReprojectTo3DKernel>(manager, program, queue);
+        if (options.commandReplay) {
+            replay = std::make_unique<CommandReplay>(queue, options.commandBuffer);
+        }
+        return true;
+    }
+
+    unsigned int getArgumentsVersion() const {
+        return costKernel->getArgumentsVersion()
+            + horizontalAggregationKernel->getArgumentsVersion()
+            + bestDisparityKernel->getArgumentsVersion();
+    }
+
+    // Launches the kernels of a frame, whose arguments are already set.
+    // When stageEvents is given, a marker event is appended after each stage.
+    bool runFrame(int frameWidth, int frameHeight, int aggregationPaths, std::vector<cl_event>* stageEvents) {
+        size_t pixels = (size_t)frameWidth * frameHeight;
+        if (!replay) {
+            return costKernel->runKernel(pixels)
+                && enqueueStageMarker(stageEvents)
+                && (aggregationPaths == 0 || horizontalAggregationKernel->runKernel(frameHeight))
+                && enqueueStageMarker(stageEvents)
+                && bestDisparityKernel->runKernel(pixels)
+                && enqueueStageMarker(stageEvents);
+        }
+
+        // A command buffer holds the arguments it was recorded with, while the
+        // launch list uses the current ones and only depends on the launches
+        unsigned int argumentsVersion = getArgumentsVersion();
+        bool sameLaunches = replay->isFinalized() && frameWidth == recordedWidth && frameHeight == recordedHeight
+            && aggregationPaths == recordedAggregationPaths;
+        if (!sameLaunches || (replay->usesCommandBuffer() && argumentsVersion != recordedArgumentsVersion)) {
+            replay->clear();
+            bool recorded = costKernel->recordLaunches(*replay, pixels)
+                && replay->addStageMarker()
+                && (aggregationPaths == 0 || horizontalAggregationKernel->recordLaunches(*replay, frameHeight))
+                && replay->addStageMarker()
+                && bestDisparityKernel->recordLaunches(*replay, pixels)
+                && replay->addStageMarker()
+                && replay->finalize();
+            if (!recorded) {
+                replay->clear();
+                return false;
+            }
+            recordedArgumentsVersion = argumentsVersion;
+            recordedWidth = frameWidth;
+            recordedHeight = frameHeight;
+            recordedAggregationPaths = aggregationPaths;
+        }
+        return replay->replay(stageEvents);
+    }
+
+    bool enqueueStageMarker(std::vector<cl_event>* events) {
+        if (!events) return true;
+        cl_event event = nullptr;
+        if (clEnqueueMarkerWithWaitList(queue, 0, nullptr, &event) != CL_SUCCESS) {
+            std::cerr << "Failed to enqueue marker" << std::endl;
+            return false;
+        }
+        events->push_back(event);
+        return true;
+    }
+
+    bool upload(cl_mem buffer, const cv::Mat& image, int frameWidth, int frameHeight) {
+        if (image.type() != CV_8UC1 || image.cols != frameWidth || image.rows != frameHeight || !image.isContinuous()) {
+            std::cerr << "Error: Expected a continuous " << frameWidth << "x" << frameHeight << " CV_8UC1 image!" << std::endl;
+            return false;
+        }
+        cl_int err = clEnqueueWriteBuffer(queue, buffer, CL_FALSE, 0, image.total(), image.data, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            std::cerr << "Error: Failed to upload image! (Error code: " << err << ")" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    OpenCLManager& manager;
+    std::shared_ptr<OpenCLProgram> program;
+    int width;
+    int height;
+    int maxDisparity;
+    StereoStreamOptions options;
+
+    // resolution of the last disparity map, which may be downscaled
+    bool hasDisparity = false;
+    int disparityWidth = 0;
+    int disparityHeight = 0;
+    int disparityDownscale = 1;
+
+    // downscaled images, kept alive until their upload completes
+    cv::Mat leftScaled;
+    cv::Mat rightScaled;
+    cv::Mat disparityScaled;
+
+    cl_command_queue queue = nullptr;
+    bool ownsQueue = false;
+
+    cl_mem leftBuffer = nullptr;
+    cl_mem rightBuffer = nullptr;
+    cl_mem costBuffer = nullptr;
+    cl_mem aggregatedBuffer = nullptr;
+    cl_mem disparityBuffer = nullptr;
+    cl_mem pointBuffer = nullptr;
+    cl_mem pointCounterBuffer = nullptr;
+
+    std::unique_ptr<SADCostKernel> costKernel;
+    std::unique_ptr<HorizontalAggregationKernel> horizontalAggregationKernel;
+    std::unique_ptr<ComputeBestDisparityKernel> bestDisparityKernel;
+    std::unique_ptr<ReprojectTo3DKernel> reprojectKernel;
+
+    std::unique_ptr<CommandReplay> replay;
+    unsigned int recordedArgumentsVersion = 0;
+    int recordedWidth = 0;
+    int recordedHeight = 0;
+    int recordedAggregationPaths = 0;
+
+    std::mutex mutex;
+};
+
+
+StereoMatcher::StereoMatcher(OpenCLManager& manager) : manager(manager) {}
+
+StereoMatcher::~StereoMatcher() {}
+
+bool StereoMatcher::initialize(const std::string& programFile) {
+    program = std::make_shared<OpenCLProgram>(manager);
+    if (!program->loadAndBuildProgram(programFile)) {
+        program.reset();
+        return false;
+    }
+    return true;
+}
+
+int StereoMatcher::createStream(int width, int height, const StereoStreamOptions& options) {
+    if (!program) {
+        std::cerr << "StereoMatcher is not initialized!" << std::endl;
+        return -1;
+    }
+    if (options.maxDisparity < 1 || options.maxDisparity > MAX_DISPARITY) {
+        std::cerr << "Unsupported stream maxDisparity " << options.maxDisparity
+            << ", must be in [1, " << MAX_DISPARITY << "]" << std::endl;
+        return -1;
+    }
+    auto stream = std::make_unique<Stream>(manager, program, width, height, options);
+    if (!stream->initialize()) {
+        std::cerr << "Failed to create stereo stream" << std::endl;
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(streamsMutex);
+    streams.push_back(std::move(stream));
+    return (int)streams.size() - 1;
+}
+
+size_t StereoMatcher::getStreamCount() const {
+    std::lock_guard<std::mutex> lock(streamsMutex);
+    return streams.size();
+}
+
+bool StereoMatcher::isUsingCommandBuffer(int streamId) const {
+    Stream* stream = getStream(streamId);
+    if (!stream) return false;
+    std::lock_guard<std::mutex> lock(stream->mutex);
+    return stream->replay && stream->replay->usesCommandBuffer();
+}
+
+StereoMatcher::Stream* StereoMatcher::getStream(int streamId) const {
+    std::lock_guard<std::mutex> lock(streamsMutex);
+    if (streamId < 0 || streamId >= (int)streams.size()) {
+        std::cerr << "Invalid stream id: " << streamId << std::endl;
+        return nullptr;
+    }
+    return streams[streamId].get();
+}
+
+// Time between the completion of two profiled commands
+static double elapsedMs(cl_event from, cl_event to) {
+    cl_ulong start = 0;
+    cl_ulong end = 0;
+    clGetEventProfilingInfo(from, CL_PROFILING_COMMAND_END, sizeof(start), &start, nullptr);
+    clGetEventProfilingInfo(to, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+    return end > start ? (end - start) * 1e-6 : 0.0;
+}
+
+bool StereoMatcher::computeDisparity(int streamId,
+    const cv::Mat& left,
+    const cv::Mat& right,
+    cv::Mat& disparity,
+    const StereoMatcherParameters& parameters,
+    StereoFrameTimings* timings) {
+    auto hostStart = std::chrono::high_resolution_clock::now();
+    Stream* stream = getStream(streamId);
+    if (!stream) return false;
+    std::lock_guard<std::mutex> lock(stream->mutex);
+
+    int downscale = std::max(1, parameters.downscale);
+    int width = stream->width / downscale;
+    int height = stream->height / downscale;
+    int maxDisparity = parameters.maxDisparity > 0 ? std::min(parameters.maxDisparity, stream->maxDisparity) : stream->maxDisparity;
+    maxDisparity = std::max(1, maxDisparity / downscale);
+    bool aggregate = parameters.aggregationPaths > 0;
+
+    // device timings are measured between markers on the profiled queue
+    bool profiling = timings && stream->options.profiling && stream->ownsQueue;
+    std::vector<cl_event> events;
+    bool success = !profiling || stream->enqueueStageMarker(&events);
+
+    stream->hasDisparity = false;
+    const cv::Mat* leftFrame = &left;
+    const cv::Mat* rightFrame = &right;
+    if (downscale > 1 && !left.empty() && !right.empty()) {
+        cv::resize(left, stream->leftScaled, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        cv::resize(right, stream->rightScaled, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        leftFrame = &stream->leftScaled;
+        rightFrame = &stream->rightScaled;
+    }
+    success = success
+        && stream->upload(stream->leftBuffer, *leftFrame, width, height)
+        && stream->upload(stream->rightBuffer, *rightFrame, width, height)
+        && (!profiling || stream->enqueueStageMarker(&events));
+
+    // only the arguments which changed since the previous frame are set
+    cl_mem matchingCosts = aggregate ? stream->aggregatedBuffer : stream->costBuffer;
+    success = success
+        && stream->costKernel->setArguments(stream->leftBuffer, stream->rightBuffer, stream->costBuffer,
+            width, height, parameters.halfWindowSize, maxDisparity)
+        && (!aggregate || stream->horizontalAggregationKernel->setArguments(stream->costBuffer, stream->aggregatedBuffer,
+            width, height, maxDisparity, parameters.P1, parameters.P2))
+        && stream->bestDisparityKernel->setArguments(matchingCosts, stream->disparityBuffer,
+            width, height, maxDisparity, parameters.uniquenessRatio)
+        && stream->runFrame(width, height, aggregate ? 1 : 0, profiling ? &events : nullptr)
+        && (!profiling || stream->enqueueStageMarker(&events));
+    if (!success) {
+        clFinish(stream->queue);
+        for (cl_event event : events) clReleaseEvent(event);
+        return false;
+    }
+
+    // The kernels were only enqueued: wait for them so that the read-back time
+    // does not include the device compute time
+    if (timings && clFinish(stream->queue) != CL_SUCCESS) {
+        std::cerr << "Failed to finish frame" << std::endl;
+        for (cl_event event : events) clReleaseEvent(event);
+        return false;
+    }
+    auto readbackStart = std::chrono::high_resolution_clock::now();
+    cv::Mat& target = downscale > 1 ? stream->disparityScaled : disparity;
+    target.create(height, width, CV_16U);
+    if (!fillMatFromOpenCLBuffer(target, stream->disparityBuffer, manager.getContext(), stream->queue)) {
+        for (cl_event event : events) clReleaseEvent(event);
+        return false;
+    }
+    if (downscale > 1) {
+        // back to full resolution, disparities included
+        cv::resize(stream->disparityScaled, disparity, cv::Size(stream->width, stream->height), 0, 0, cv::INTER_NEAREST);
+        disparity *= downscale;
+    }
+    stream->hasDisparity = true;
+    stream->disparityWidth = width;
+    stream->disparityHeight = height;
+    stream->disparityDownscale = downscale;
+
+    if (timings) {
+        auto hostEnd = std::chrono::high_resolution_clock::now();
+        *timings = StereoFrameTimings();
+        timings->readbackMs = std::chrono::duration<double, std::milli>(hostEnd - readbackStart).count();
+        timings->totalMs = std::chrono::duration<double, std::milli>(hostEnd - hostStart).count();
+        // start, upload, [cost, aggregation, disparity], compute
+        if (profiling && events.size() >= 3) {
+            timings->deviceTimings = true;
+            timings->uploadMs = elapsedMs(events[0], events[1]);
+            timings->computeMs = elapsedMs(events[1], events.back());
+            if (events.size() == 6) {
+                timings->stageBreakdown = true;
+                timings->costMs = elapsedMs(events[1], events[2]);
+                timings->aggregationMs = elapsedMs(events[2], events[3]);
+                timings->disparityMs = elapsedMs(events[3], events[4]);
+            }
+        }
+    }
+    for (cl_event event : events) clReleaseEvent(event);
+    return true;
+}
+
+bool StereoMatcher::computePointCloud(int streamId, const cv::Matx44d& Q, cv::Mat& points, bool compact) {
+    Stream* stream = getStream(streamId);
+    if (!stream) return false;
+    std::lock_guard<std::mutex> lock(stream->mutex);
+
+    if (!stream->hasDisparity) {
+        std::cerr << "Error: No disparity map computed for stream " << streamId << std::endl;
+        return false;
+    }
+
+    // The device buffer holds the disparity map at the matched resolution:
+    // scale pixel coordinates and disparities back to the resolution of Q
+    int width = stream->disparityWidth;
+    int height = stream->disparityHeight;
+    double scale = stream->disparityDownscale;
+    cv::Matx44d scaledQ = Q * cv::Matx44d::diag(cv::Vec4d(scale, scale, scale, 1.0));
+    if (!stream->reprojectKernel->setArguments(stream->disparityBuffer, stream->leftBuffer, stream->pointBuffer,
+            stream->pointCounterBuffer, width, height, scaledQ, compact)
+        || !stream->reprojectKernel->runKernel((size_t)width * height)) {
+        return false;
+    }
+
+    if (compact) {
+        return fillPointCloudFromOpenCLBuffer(points, stream->pointBuffer, stream->pointCounterBuffer, stream->queue);
+    }
+    points.create(height, width, CV_32FC4);
+    return fillMatFromOpenCLBuffer(points, stream->pointBuffer, manager.getContext(), stream->queue);
+}
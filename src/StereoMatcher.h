@@ -0,0 +1,105 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <opencv2/core.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "OpenCLManager.h"
+#include "OpenCLProgram.h"
+
+struct StereoMatcherParameters {
+    int halfWindowSize = 2;
+    int P1 = 100;
+    int P2 = 1000;
+    float uniquenessRatio = 0.25f;
+    // Disparity range in full resolution pixels, 0 for the stream's maxDisparity
+    int maxDisparity = 0;
+    // The pair is matched at 1/downscale of its resolution, and the disparity
+    // map is upsampled back to the full resolution
+    int downscale = 1;
+    // Number of aggregation paths: 0 (raw matching costs) or 1 (horizontal)
+    int aggregationPaths = 1;
+};
+
+// Durations of the stages of a frame, in milliseconds. The device stages are
+// only measured on streams created with profiling enabled, and the breakdown
+// of the compute stage is not available when replaying a command buffer.
+struct StereoFrameTimings {
+    double uploadMs = 0.0;
+    double costMs = 0.0;
+    double aggregationMs = 0.0;
+    double disparityMs = 0.0;
+    double computeMs = 0.0;     // cost + aggregation + disparity
+    double readbackMs = 0.0;    // host measured once the device work completed: transfer and upsampling
+    double totalMs = 0.0;       // host measured, whole computeDisparity call
+    bool deviceTimings = false;
+    bool stageBreakdown = false;
+};
+
+struct StereoStreamOptions {
+    // At most StereoMatcher::MAX_DISPARITY
+    int maxDisparity = 64;
+    // Enqueue on a queue owned by the stream instead of the manager's queue
+    bool dedicatedQueue = true;
+    // Record the launches of a frame once per configuration and replay them
+    // every frame (see CommandReplay), instead of launching and waiting for
+    // each kernel individually
+    bool commandReplay = true;
+    // Replay through cl_khr_command_buffer when the device supports it
+    bool commandBuffer = true;
+    // Create the queue with profiling enabled to measure StereoFrameTimings
+    // on the device (requires dedicatedQueue)
+    bool profiling = false;
+};
+
+// Stereo matching engine serving several camera pairs ("streams") on one device.
+// The context and the program are shared, while each stream owns its buffers,
+// its kernels and optionally a dedicated command queue, so that frames of
+// different streams can be submitted concurrently from different threads and
+// interleaved by the device. Calls on the same stream are serialized.
+class StereoMatcher {
+public:
+    // Width of the local cost tiles of horizontalAggregation, must match MAX_DISPARITY in kernels.cl
+    static const int MAX_DISPARITY = 64;
+
+    StereoMatcher(OpenCLManager& manager);
+    ~StereoMatcher();
+
+    bool initialize(const std::string& programFile = "kernels.cl");
+
+    // Allocates a stream for images of the given size. Returns the stream id,
+    // or -1 on failure (including a maxDisparity outside [1, MAX_DISPARITY]).
+    // Thread-safe.
+    int createStream(int width, int height, const StereoStreamOptions& options = StereoStreamOptions());
+
+    // Computes the DISP_SCALE-encoded disparity map (CV_16U) of a rectified
+    // CV_8UC1 pair matching the size of the stream.
+    bool computeDisparity(int streamId,
+        const cv::Mat& left,
+        const cv::Mat& right,
+        cv::Mat& disparity,
+        const StereoMatcherParameters& parameters,
+        StereoFrameTimings* timings = nullptr);
+
+    // Reprojects the last disparity map of the stream to 3D with Q, given for the
+    // full resolution. In compact mode points is N x 1 and holds only the valid
+    // points, otherwise it has the matched (possibly downscaled) resolution with
+    // NaN for invalid pixels (CV_32FC4: x, y, z, intensity).
+    bool computePointCloud(int streamId, const cv::Matx44d& Q, cv::Mat& points, bool compact = true);
+
+    size_t getStreamCount() const;
+    // Whether the frames of the stream are replayed through a command buffer
+    // (known after the first frame)
+    bool isUsingCommandBuffer(int streamId) const;
+
+private:
+    class Stream;
+    Stream* getStream(int streamId) const;
+
+    OpenCLManager& manager;
+    std::shared_ptr<OpenCLProgram> program;
+    std::vector<std::unique_ptr<Stream>> streams;
+    mutable std::mutex streamsMutex;
+};
@@ -6,6 +6,11 @@ ComputeBestDisparityKernel::ComputeBestDisparityKernel(OpenCLManager& manager) :
 {
 }
 
+ComputeBestDisparityKernel::ComputeBestDisparityKernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, cl_command_queue queue) :
+	Kernel(manager, std::move(program), "computeBestDisparity", queue)
+{
+}
+
 bool ComputeBestDisparityKernel::setArguments(cl_mem aggregatedCosts,
 	cl_mem disparityBuffer,
 	int width,
@@ -16,12 +21,12 @@ bool ComputeBestDisparityKernel::setArguments(cl_mem aggregatedCosts,
 	cl_int err;
 	// Set the kernel arguments
 	int i = 0;
-	err = clSetKernelArg(kernel, i++, sizeof(cl_mem), &aggregatedCosts);
-	err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &disparityBuffer);
-	err |= clSetKernelArg(kernel, i++, sizeof(int), &width);
-	err |= clSetKernelArg(kernel, i++, sizeof(int), &height);
-	err |= clSetKernelArg(kernel, i++, sizeof(int), &maxDisparity);
-	err |= clSetKernelArg(kernel, i++, sizeof(float), &uniquenessRatio);
+	err = setArgument(i++, aggregatedCosts);
+	err |= setArgument(i++, disparityBuffer);
+	err |= setArgument(i++, width);
+	err |= setArgument(i++, height);
+	err |= setArgument(i++, maxDisparity);
+	err |= setArgument(i++, uniquenessRatio);
 	if (err != CL_SUCCESS) {
 		std::cerr << "Failed to set kernel arguments" << std::endl;
 		return false;
@@ -6,6 +6,7 @@
 class ComputeBestDisparityKernel : public Kernel {
 public:
 	ComputeBestDisparityKernel(OpenCLManager& manager);
+	ComputeBestDisparityKernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, cl_command_queue queue = nullptr);
 	bool setArguments(cl_mem aggregatedCosts,
 		cl_mem disparityBuffer,
 		int width,
@@ -1,10 +1,19 @@
 #include "HorizontalAggregationKernel.h"
+#include "../CommandReplay.h"
+
+// Must match TILE_SIZE in kernels.cl
+static const int TILE_SIZE = 32;
 
 HorizontalAggregationKernel::HorizontalAggregationKernel(OpenCLManager& manager) :
 	Kernel(manager, "kernels.cl", "horizontalAggregation")
 {
 }
 
+HorizontalAggregationKernel::HorizontalAggregationKernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, cl_command_queue queue) :
+	Kernel(manager, std::move(program), "horizontalAggregation", queue)
+{
+}
+
 bool HorizontalAggregationKernel::setArguments(cl_mem costBuffer, 
 	cl_mem aggregatedCostBuffer,
 	int width,
@@ -18,15 +27,15 @@ bool HorizontalAggregationKernel::setArguments(cl_mem costBuffer,
 	cl_int err;
 	// Set the kernel arguments
 	int i = 0;
-	err = clSetKernelArg(kernel, i++, sizeof(cl_mem), &costBuffer);
-	err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &aggregatedCostBuffer);
-	err |= clSetKernelArg(kernel, i++, sizeof(int), &width);
-	err |= clSetKernelArg(kernel, i++, sizeof(int), &height);
-	err |= clSetKernelArg(kernel, i++, sizeof(int), &maxDisparity);
+	err = setArgument(i++, costBuffer);
+	err |= setArgument(i++, aggregatedCostBuffer);
+	err |= setArgument(i++, width);
+	err |= setArgument(i++, height);
+	err |= setArgument(i++, maxDisparity);
 	float p1 = P1; 
 	float p2 = P2;
-	err |= clSetKernelArg(kernel, i++, sizeof(float), &p1);
-	err |= clSetKernelArg(kernel, i++, sizeof(float), &p2);
+	err |= setArgument(i++, p1);
+	err |= setArgument(i++, p2);
 	if (err != CL_SUCCESS) {
 		std::cerr << "Failed to set kernel arguments" << std::endl;
 		return false;
@@ -39,8 +48,7 @@ bool HorizontalAggregationKernel::runKernel(size_t globalSize)
 #ifndef DISABLE_KERNEL
 	cl_int err; 
 	 
-	const int TILE_SIZE = 32;
-	int tileNumber =  _width / TILE_SIZE;
+	int tileNumber = (_width + TILE_SIZE - 1) / TILE_SIZE;  // last tile may be partial
 	for (int tileIndex = 0; tileIndex < tileNumber; ++tileIndex) {
 		err = clSetKernelArg(kernel, 7, sizeof(float), &tileIndex);
 		if (err != CL_SUCCESS) {
@@ -52,7 +60,7 @@ bool HorizontalAggregationKernel::runKernel(size_t globalSize)
 		size_t localWorkSize[2] = { TILE_SIZE, 1 };  // Local size for each workgroup
 
 		// Enqueue the kernel for execution
-		err |= clEnqueueNDRangeKernel(manager.getCommandQueue(), kernel, 2, nullptr, globalWorkSize, localWorkSize, 0, nullptr, nullptr);
+		err |= clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, globalWorkSize, localWorkSize, 0, nullptr, nullptr);
 		   
 		if (err != CL_SUCCESS) {
 			std::cerr << "Failed to enqueue kernel " << err << std::endl;
@@ -60,7 +68,7 @@ bool HorizontalAggregationKernel::runKernel(size_t globalSize)
 		}
 
 		// Wait for the kernel to finish executing
-		clFinish(manager.getCommandQueue());
+		clFinish(queue);
 	}
 	return true;
 	
@@ -69,3 +77,31 @@ bool HorizontalAggregationKernel::runKernel(size_t globalSize)
 	return Kernel::runKernel(globalSize);
 #endif	
 }
+
+bool HorizontalAggregationKernel::recordLaunches(CommandReplay& replay, size_t /*globalSize*/)
+{
+	// One kernel per tile with its tile index bound once, so that the tiles
+	// can be replayed without setting any argument
+	int tileNumber = (_width + TILE_SIZE - 1) / TILE_SIZE;  // last tile may be partial
+	while ((int)tileKernels.size() < tileNumber) {
+		cl_kernel tileKernel = createClone();
+		if (!tileKernel) {
+			return false;
+		}
+		int tileIndex = (int)tileKernels.size();
+		if (clSetKernelArg(tileKernel, 7, sizeof(int), &tileIndex) != CL_SUCCESS) {
+			std::cerr << "Failed to set kernel arguments" << std::endl;
+			return false;
+		}
+		tileKernels.push_back(tileKernel);
+	}
+
+	size_t globalWorkSize[2] = { (size_t)(TILE_SIZE), (size_t)(_height) };
+	size_t localWorkSize[2] = { TILE_SIZE, 1 };
+	for (int tileIndex = 0; tileIndex < tileNumber; ++tileIndex) {
+		if (!replay.addLaunch(tileKernels[tileIndex], 2, globalWorkSize, localWorkSize)) {
+			return false;
+		}
+	}
+	return true;
+}
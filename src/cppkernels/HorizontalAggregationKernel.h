@@ -5,6 +5,7 @@
 class HorizontalAggregationKernel : public Kernel {
 public:
 	HorizontalAggregationKernel(OpenCLManager& manager);
+	HorizontalAggregationKernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, cl_command_queue queue = nullptr);
 	bool setArguments(cl_mem costBuffer, 
 		cl_mem aggregatedCostBuffer, 
 		int width, 
@@ -13,7 +14,9 @@ public:
 		int P1,
 		int P2);
 	virtual bool runKernel(size_t globalSize);  // Run the kernel
+	virtual bool recordLaunches(CommandReplay& replay, size_t globalSize);
 
 	int _width;
 	int _height;
+	std::vector<cl_kernel> tileKernels;  // clones of kernel, one per tile
 };
\ No newline at end of file
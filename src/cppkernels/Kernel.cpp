@@ -1,28 +1,105 @@
 #include "Kernel.h"
+#include <cstring>
 #include "../OpenCLManager.h"
+#include "../CommandReplay.h"
 
 Kernel::Kernel(OpenCLManager& manager, const std::string& kernelPath, const std::string& kernelName) :
 	manager(manager),
-	program(manager)
+	program(std::make_shared<OpenCLProgram>(manager)),
+	kernelName(kernelName),
+	kernel(nullptr),
+	queue(manager.getCommandQueue())
 {
+	program->loadAndBuildProgram(kernelPath);
+	createKernel();
+}
+
+Kernel::Kernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, const std::string& kernelName, cl_command_queue queue) :
+	manager(manager),
+	program(std::move(program)),
+	kernelName(kernelName),
+	kernel(nullptr),
+	queue(queue ? queue : manager.getCommandQueue())
+{
+	createKernel();
+}
+
+Kernel::~Kernel() {
+	for (cl_kernel clone : clones) {
+		clReleaseKernel(clone);
+	}
+	if (kernel) {
+		clReleaseKernel(kernel);
+	}
+}
+
+void Kernel::createKernel() {
+	cl_int err;
+	kernel = clCreateKernel(program->getProgram(), kernelName.c_str(), &err);
+	if (err != CL_SUCCESS) {
+		std::cerr << "Failed to create kernel: " << kernelName << std::endl;
+		kernel = nullptr;
+	}
+}
+
+cl_int Kernel::setArgument(cl_uint index, size_t size, const void* value) {
+	if (index >= arguments.size()) {
+		arguments.resize(index + 1);
+	}
+	std::vector<unsigned char>& cached = arguments[index];
+	if (cached.size() == size && memcmp(cached.data(), value, size) == 0) {
+		return CL_SUCCESS;
+	}
+
+	cl_int err = clSetKernelArg(kernel, index, size, value);
+	for (cl_kernel clone : clones) {
+		err |= clSetKernelArg(clone, index, size, value);
+	}
+	if (err != CL_SUCCESS) {
+		cached.clear();
+		return err;
+	}
+	const unsigned char* bytes = static_cast<const unsigned char*>(value);
+	cached.assign(bytes, bytes + size);
+	argumentsVersion++;
+	return CL_SUCCESS;
+}
+
+cl_kernel Kernel::createClone() {
 	cl_int err;
-	program.loadAndBuildProgram(kernelPath);
-	kernel = clCreateKernel(program.getProgram(), kernelName.c_str(), &err);
+	cl_kernel clone = clCreateKernel(program->getProgram(), kernelName.c_str(), &err);
 	if (err != CL_SUCCESS) {
 		std::cerr << "Failed to create kernel: " << kernelName << std::endl;
+		return nullptr;
+	}
+	for (cl_uint i = 0; i < arguments.size(); ++i) {
+		if (!arguments[i].empty()) {
+			err |= clSetKernelArg(clone, i, arguments[i].size(), arguments[i].data());
+		}
+	}
+	if (err != CL_SUCCESS) {
+		std::cerr << "Failed to set kernel arguments" << std::endl;
+		clReleaseKernel(clone);
+		return nullptr;
 	}
+	clones.push_back(clone);
+	return clone;
 }
 
 
 bool Kernel::runKernel(size_t globalSize) {
 	cl_int err;
 	// Enqueue the kernel for execution
-	err = clEnqueueNDRangeKernel(manager.getCommandQueue(), kernel, 1, nullptr, &globalSize, nullptr, 0, nullptr, nullptr);
+	err = clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &globalSize, nullptr, 0, nullptr, nullptr);
 	if (err != CL_SUCCESS) {
 		std::cerr << "Failed to enqueue kernel" << std::endl;
 		return false;
 	}
 	// Wait for the kernel to finish executing
-	clFinish(manager.getCommandQueue());
+	clFinish(queue);
 	return true;
-}
\ No newline at end of file
+}
+
+bool Kernel::recordLaunches(CommandReplay& replay, size_t globalSize) {
+	return replay.addLaunch(kernel, 1, &globalSize, nullptr);
+}
@@ -2,18 +2,51 @@
 
 #include <CL/cl.h>
 #include <iostream>
+#include <memory>
+#include <vector>
 #include "../OpenCLProgram.h"
 
 class OpenCLManager;
+class CommandReplay;
 
 class Kernel {
 public:
     Kernel(OpenCLManager& manager, const std::string& kernelPath, const std::string& kernelName);
-    virtual ~Kernel() {}
+    // Creates the kernel from a program already built and shared with other kernels.
+    // The kernel is enqueued on queue, or on the manager's queue if queue is null.
+    Kernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, const std::string& kernelName, cl_command_queue queue = nullptr);
+    virtual ~Kernel();
+    // Owns its cl_kernel handles
+    Kernel(const Kernel&) = delete;
+    Kernel& operator=(const Kernel&) = delete;
     virtual bool runKernel(size_t globalSize);  // Run the kernel
+    // Appends the launches of runKernel to replay, without waiting between them.
+    virtual bool recordLaunches(CommandReplay& replay, size_t globalSize);
+
+    // Incremented every time an argument actually changes
+    unsigned int getArgumentsVersion() const { return argumentsVersion; }
 
 protected:
+    // Sets a kernel argument, skipping clSetKernelArg if the value did not change.
+    // Changes are forwarded to the clones of the kernel.
+    cl_int setArgument(cl_uint index, size_t size, const void* value);
+    template <typename T>
+    cl_int setArgument(cl_uint index, const T& value) { return setArgument(index, sizeof(T), &value); }
+
+    // Creates another cl_kernel with the current arguments, kept in sync by
+    // setArgument. It is owned and released by this object.
+    cl_kernel createClone();
+
     OpenCLManager& manager;
-    OpenCLProgram program;
+    std::shared_ptr<OpenCLProgram> program;
+    std::string kernelName;
     cl_kernel kernel;
+    cl_command_queue queue;
+
+private:
+    void createKernel();
+
+    std::vector<std::vector<unsigned char>> arguments;
+    std::vector<cl_kernel> clones;
+    unsigned int argumentsVersion = 0;
 };
@@ -0,0 +1,59 @@
+#include "ReprojectTo3DKernel.h"
+
+ReprojectTo3DKernel::ReprojectTo3DKernel(OpenCLManager& manager) :
+	Kernel(manager, "kernels.cl", "reprojectDisparityTo3D")
+{
+}
+
+ReprojectTo3DKernel::ReprojectTo3DKernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, cl_command_queue queue) :
+	Kernel(manager, std::move(program), "reprojectDisparityTo3D", queue)
+{
+}
+
+bool ReprojectTo3DKernel::setArguments(cl_mem disparityBuffer,
+	cl_mem intensityBuffer,
+	cl_mem pointBuffer,
+	cl_mem pointCounterBuffer,
+	int width,
+	int height,
+	const cv::Matx44d& Q,
+	bool compact)
+{
+	_pointCounterBuffer = pointCounterBuffer;
+	_compact = compact;
+	cl_float16 q;
+	for (int i = 0; i < 16; ++i) {
+		q.s[i] = (cl_float)Q.val[i];
+	}
+	int compactFlag = compact ? 1 : 0;
+	cl_int err;
+	// Set the kernel arguments
+	int i = 0;
+	err = setArgument(i++, disparityBuffer);
+	err |= setArgument(i++, intensityBuffer);
+	err |= setArgument(i++, pointBuffer);
+	err |= setArgument(i++, pointCounterBuffer);
+	err |= setArgument(i++, width);
+	err |= setArgument(i++, height);
+	err |= setArgument(i++, q);
+	err |= setArgument(i++, compactFlag);
+	if (err != CL_SUCCESS) {
+		std::cerr << "Failed to set kernel arguments" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ReprojectTo3DKernel::runKernel(size_t globalSize)
+{
+	if (_compact) {
+		// The packed points are appended through an atomic counter
+		cl_uint zero = 0;
+		cl_int err = clEnqueueFillBuffer(queue, _pointCounterBuffer, &zero, sizeof(zero), 0, sizeof(zero), 0, nullptr, nullptr);
+		if (err != CL_SUCCESS) {
+			std::cerr << "Failed to reset point counter " << err << std::endl;
+			return false;
+		}
+	}
+	return Kernel::runKernel(globalSize);
+}
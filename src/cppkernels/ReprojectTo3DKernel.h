@@ -0,0 +1,25 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include "Kernel.h"
+
+class ReprojectTo3DKernel : public Kernel {
+public:
+	ReprojectTo3DKernel(OpenCLManager& manager);
+	ReprojectTo3DKernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, cl_command_queue queue = nullptr);
+	// Q is the 4x4 reprojection matrix (as returned by cv::stereoRectify).
+	// When compact is true, only valid points are packed into pointBuffer and
+	// their number is written to pointCounterBuffer.
+	bool setArguments(cl_mem disparityBuffer,
+		cl_mem intensityBuffer,
+		cl_mem pointBuffer,
+		cl_mem pointCounterBuffer,
+		int width,
+		int height,
+		const cv::Matx44d& Q,
+		bool compact);
+	virtual bool runKernel(size_t globalSize);  // Run the kernel
+
+	cl_mem _pointCounterBuffer = nullptr;
+	bool _compact = false;
+};
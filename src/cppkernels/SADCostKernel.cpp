@@ -5,6 +5,11 @@ SADCostKernel::SADCostKernel(OpenCLManager& manager) :
 {
 }
 
+SADCostKernel::SADCostKernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, cl_command_queue queue) :
+	Kernel(manager, std::move(program), "computeSADCosts", queue)
+{
+}
+
 bool SADCostKernel::setArguments(cl_mem leftImageBuffer, 
     cl_mem rightImageBuffer, 
     cl_mem outputCostFunctionBuffer, 
@@ -15,13 +20,13 @@ bool SADCostKernel::setArguments(cl_mem leftImageBuffer,
 {
     cl_int err;
     // Set the kernel arguments
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &leftImageBuffer);
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &rightImageBuffer);
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &outputCostFunctionBuffer);
-    err |= clSetKernelArg(kernel, 3, sizeof(int), &width);
-    err |= clSetKernelArg(kernel, 4, sizeof(int), &height);
-    err |= clSetKernelArg(kernel, 5, sizeof(int), &halfWindowSize);
-    err |= clSetKernelArg(kernel, 6, sizeof(int), &disparityRange);
+    err = setArgument(0, leftImageBuffer);
+    err |= setArgument(1, rightImageBuffer);
+    err |= setArgument(2, outputCostFunctionBuffer);
+    err |= setArgument(3, width);
+    err |= setArgument(4, height);
+    err |= setArgument(5, halfWindowSize);
+    err |= setArgument(6, disparityRange);
     if (err != CL_SUCCESS) {
         std::cerr << "Failed to set kernel arguments" << std::endl;
         return false;
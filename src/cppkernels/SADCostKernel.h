@@ -6,6 +6,7 @@
 class SADCostKernel: public Kernel {
 public:
     SADCostKernel(OpenCLManager& manager);
+    SADCostKernel(OpenCLManager& manager, std::shared_ptr<OpenCLProgram> program, cl_command_queue queue = nullptr);
     bool setArguments(cl_mem leftImageBuffer, 
         cl_mem rightImageBuffer,
         cl_mem outputCostFunctionBuffer, 
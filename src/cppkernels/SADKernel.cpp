@@ -17,13 +17,13 @@ bool SADKernel::setArguments(cl_mem leftImageBuffer,
     cl_int err;
 
     // Set the kernel arguments
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &leftImageBuffer);    
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &rightImageBuffer);   
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &disparityBuffer);    
-    err |= clSetKernelArg(kernel, 3, sizeof(int), &width);            
-    err |= clSetKernelArg(kernel, 4, sizeof(int), &height);             
-    err |= clSetKernelArg(kernel, 5, sizeof(int), &maxDisparity);            
-    err |= clSetKernelArg(kernel, 6, sizeof(int), &windowSize);            
+    err = setArgument(0, leftImageBuffer);    
+    err |= setArgument(1, rightImageBuffer);   
+    err |= setArgument(2, disparityBuffer);    
+    err |= setArgument(3, width);            
+    err |= setArgument(4, height);             
+    err |= setArgument(5, maxDisparity);            
+    err |= setArgument(6, windowSize);            
     if (err != CL_SUCCESS) {
         std::cerr << "Failed to set kernel arguments" << std::endl;
         return false;
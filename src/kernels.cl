@@ -28,10 +28,14 @@ __kernel void computeSADCosts(__global const uchar* leftImage,   // Left image (
             float sad = 0.0f;
 
             // Calculate the SAD by comparing corresponding pixels in the left and right image
+            // (window pixels outside of the images are clamped to the border)
             for (int dy = -halfWindowSize; dy <= halfWindowSize; ++dy) {
+                int windowY = clamp(y + dy, 0, height - 1);
                 for (int dx = -halfWindowSize; dx <= halfWindowSize; ++dx) {
-                    int leftPixel = leftImage[(y + dy) * width + (x + dx)];
-                    int rightPixel = rightImage[(y + dy) * width + (rightX + dx)];
+                    int leftX = clamp(x + dx, 0, width - 1);
+                    int windowRightX = clamp(rightX + dx, 0, width - 1);
+                    int leftPixel = leftImage[windowY * width + leftX];
+                    int rightPixel = rightImage[windowY * width + windowRightX];
                     sad += fabs((float)(leftPixel - rightPixel));
                 }
             }
@@ -77,10 +81,12 @@ __kernel void horizontalAggregation(
     float minCostPrevX = FLT_MAX;
     float minCostCurrX = FLT_MAX;
     for (int d = disparityStart; d < disparityEnd; d++) {
-		// load the prefix column of the tile from the previous tile
-        aggTile[0][d] = aggregatedCost[(y * width + (group_x - 1)) * disparityRange + d];
+		// load the prefix column of the tile from the previous tile. The first
+		// tile has none: a zero column makes its first pixel start at its own cost
+        aggTile[0][d] = tileIndex > 0 ? aggregatedCost[(y * width + (group_x - 1)) * disparityRange + d] : 0.0f;
 		minCostCurrX = fmin(minCostCurrX, aggTile[0][d]);
-		for (int x = group_x; x < group_x + TILE_SIZE; x++) {
+		// the last tile may be partial when width is not a multiple of TILE_SIZE
+		for (int x = group_x; x < group_x + TILE_SIZE && x < width; x++) {
 			int xInTile = x - group_x;
 			costTile[xInTile][d] = costFunction[(y * width + x) * disparityRange + d];
 			aggTile[xInTile + 1][d] = 0;
@@ -217,6 +223,79 @@ __kernel void computeBestDisparity(__global float* aggregatedCost,   // Input ag
 }
 
 
+// Reprojects the DISP_SCALE-encoded disparity map to 3D with the 4x4 Q matrix
+// (same convention as cv::reprojectImageTo3D): [X Y Z W] = Q * [x y d 1].
+// Each output point is (X/W, Y/W, Z/W, intensity).
+// - compact == 0: dense output, one point per pixel, invalid pixels are NaN
+// - compact != 0: only valid points are written, packed at the start of the
+//   buffer, and pointCounter receives their number. The order of the packed
+//   points is not deterministic. pointCounter must be zeroed before the launch.
+__kernel void reprojectDisparityTo3D(
+    __global const ushort* disparityMap,    // Input disparity map (DISP_SCALE fixed point)
+    __global const uchar* intensityImage,   // Left image (grayscale), used as point intensity
+    __global float4* points,                // Output points (x, y, z, intensity)
+    volatile __global uint* pointCounter,   // Number of packed points (compact mode only)
+    const int width,
+    const int height,
+    const float16 Q,                        // Row-major reprojection matrix
+    const int compact) {
+
+    int idx = get_global_id(0);
+    int x = idx % width;
+    int y = idx / width;
+    bool inside = idx < width * height;
+
+    float4 point = (float4)(NAN, NAN, NAN, 0.0f);
+    bool valid = false;
+    if (inside) {
+        ushort disparity = disparityMap[idx];
+        if (disparity != INVALID_DISP) {
+            float d = (float)disparity / DISP_SCALE;
+            float X = Q.s0 * x + Q.s1 * y + Q.s2 * d + Q.s3;
+            float Y = Q.s4 * x + Q.s5 * y + Q.s6 * d + Q.s7;
+            float Z = Q.s8 * x + Q.s9 * y + Q.sa * d + Q.sb;
+            float W = Q.sc * x + Q.sd * y + Q.se * d + Q.sf;
+            if (W != 0.0f) {
+                float invW = 1.0f / W;
+                point = (float4)(X * invW, Y * invW, Z * invW, (float)intensityImage[idx]);
+                valid = true;
+            }
+        }
+    }
+
+    if (!compact) {
+        if (inside) {
+            points[idx] = point;
+        }
+        return;
+    }
+
+    // Stream compaction: reserve the slots of the work group with a single
+    // global atomic instead of one per valid pixel
+    __local uint groupCount;
+    __local uint groupOffset;
+    if (get_local_id(0) == 0) {
+        groupCount = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    uint localSlot = 0;
+    if (valid) {
+        localSlot = atomic_inc(&groupCount);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (get_local_id(0) == 0 && groupCount > 0) {
+        groupOffset = atomic_add(pointCounter, groupCount);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (valid) {
+        points[groupOffset + localSlot] = point;
+    }
+}
+
+
 
 __kernel void computeSAD(
     __global const uchar* leftImage,  // Left image (grayscale)
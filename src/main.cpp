@@ -1,11 +1,7 @@
 ﻿#include <opencv2/opencv.hpp>
 #include "OpenCLDeviceSelector.h"
-#include "cppkernels/SADCostKernel.h"
-#include "cppkernels/SADKernel.h"
-#include "cppkernels/HorizontalAggregationKernel.h"
-#include "cppkernels/ComputeBestDisparityKernel.h"
-
-#include "OpenCVHelper.h"
+#include "StereoMatcher.h"
+#include "LatencyGovernor.h"
 
 #include "OpenCLManager.h"
 #include <iostream>
@@ -65,47 +61,73 @@ int main()
 	cv::resize(left, left, cv::Size(width, height));
 	cv::resize(right, right, cv::Size(width, height));
 	cv::Mat disparity = cv::Mat(height, width, CV_16U);
-	auto leftBuffer = createOpenCLBufferFromMat(left, manager.getContext(), manager.getCommandQueue(), false);
-	auto rightBuffer = createOpenCLBufferFromMat(right, manager.getContext(), manager.getCommandQueue(), false);
-	auto costBuffer = createCostsOpenCLBuffer(width * height * maxDisparity, manager.getContext(), manager.getCommandQueue());
-	auto aggregatedBuffer = createCostsOpenCLBuffer(width * height * maxDisparity, manager.getContext(), manager.getCommandQueue());
-	auto disparityBuffer = createOpenCLBufferFromMat(disparity, manager.getContext(), manager.getCommandQueue(), true);
-
-	SADCostKernel costKernel(manager);
-	HorizontalAggregationKernel horizontalAggregationKernel(manager);
-	ComputeBestDisparityKernel bestDisparityKernel(manager);
+
+	StereoMatcher matcher(manager);
+	if (!matcher.initialize("kernels.cl")) {
+		std::cerr << "Failed to initialize stereo matcher!" << std::endl;
+		return 1;
+	}
+	// the latency governor adapts the matcher settings to hold a frame time budget
+	bool useGovernor = false;
+	LatencyGovernorSettings governorSettings;
+	governorSettings.budgetMs = 20.0;
+	LatencyGovernor governor(governorSettings);
+	StereoFrameTimings timings;
+
+	StereoStreamOptions streamOptions;
+	streamOptions.maxDisparity = maxDisparity;
+	streamOptions.profiling = useGovernor;
+	int streamId = matcher.createStream(width, height, streamOptions);
+	if (streamId < 0) {
+		std::cerr << "Failed to create stereo stream!" << std::endl;
+		return 1;
+	}
+
+	// reprojection matrix (cv::stereoRectify convention), placeholder calibration:
+	// disabled until a real calibration is loaded, as it slows down every frame
+	bool computePointCloud = false;
+	double focalLength = 500.0;
+	double baseline = 0.1;
+	cv::Matx44d Q(
+		1, 0, 0, -width / 2.0,
+		0, 1, 0, -height / 2.0,
+		0, 0, 0, focalLength,
+		0, 0, 1.0 / baseline, 0);
+	cv::Mat points;
 	 
 	// create opencv window with sliders
-	int P1 = 100;
-	int P2 = 1000;
-	int halfWindowSize = 2;
-	float uniquenessRatio = 0.25;
+	StereoMatcherParameters parameters;
 	cv::namedWindow("parameters", cv::WINDOW_AUTOSIZE);
-	cv::createTrackbar("P1", "parameters", &P1, 800);
-	cv::createTrackbar("P2", "parameters", &P2, 2000);
-	cv::createTrackbar("halfWindowSize", "parameters", &halfWindowSize, 6);
-	createFloatTrackbar("uniquenessRatio", "parameters", uniquenessRatio, 1.0f);
+	cv::createTrackbar("P1", "parameters", &parameters.P1, 800);
+	cv::createTrackbar("P2", "parameters", &parameters.P2, 2000);
+	cv::createTrackbar("halfWindowSize", "parameters", &parameters.halfWindowSize, 6);
+	createFloatTrackbar("uniquenessRatio", "parameters", parameters.uniquenessRatio, 1.0f);
 	 
 	while (true) {
 		  
 
 		// update trackbar values 
-		P1 = cv::getTrackbarPos("P1", "parameters");
-		P2 = cv::getTrackbarPos("P2", "parameters"); 
-		halfWindowSize = cv::getTrackbarPos("halfWindowSize", "parameters");
-		uniquenessRatio = getFloatTrackBarPos("uniquenessRatio", "parameters");
+		parameters.P1 = cv::getTrackbarPos("P1", "parameters");
+		parameters.P2 = cv::getTrackbarPos("P2", "parameters"); 
+		parameters.halfWindowSize = cv::getTrackbarPos("halfWindowSize", "parameters");
+		parameters.uniquenessRatio = getFloatTrackBarPos("uniquenessRatio", "parameters");
 
-		costKernel.setArguments(leftBuffer, rightBuffer, costBuffer, width, height, halfWindowSize, maxDisparity);
-		costKernel.runKernel(left.cols * left.rows);
-		  
-		horizontalAggregationKernel.setArguments(costBuffer, aggregatedBuffer, width, height, maxDisparity, P1, P2);
-		horizontalAggregationKernel.runKernel(left.rows);
-		
-
-		bestDisparityKernel.setArguments(aggregatedBuffer, disparityBuffer, width, height, maxDisparity, uniquenessRatio);
-		bestDisparityKernel.runKernel(left.cols * left.rows);
-		 
-		fillMatFromOpenCLBuffer(disparity, disparityBuffer, manager.getContext(), manager.getCommandQueue());
+		if (useGovernor) {
+			governor.apply(parameters);
+		}
+
+		if (!matcher.computeDisparity(streamId, left, right, disparity, parameters, &timings)) {
+			std::cerr << "Failed to compute disparity!" << std::endl;
+			return 1;
+		}
+
+		if (useGovernor) {
+			governor.update(timings);
+		}
+
+		if (computePointCloud) {
+			matcher.computePointCloud(streamId, Q, points, true);
+		}
 		    
 		  
 		bool debug = true;   
@@ -132,7 +154,14 @@ int main()
 		auto end = std::chrono::high_resolution_clock::now();
 		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 		if (duration > 1000) {
-			std::cout << "FPS: " << frameCounter << std::endl;
+			std::cout << "FPS: " << frameCounter;
+			if (computePointCloud) {
+				std::cout << " (" << points.rows << " points)";
+			}
+			if (useGovernor) {
+				std::cout << " level: " << governor.getLevelIndex() << " deadline misses: " << governor.getDeadlineMissCount();
+			}
+			std::cout << std::endl;
 			frameCounter = 0; 
 			start = std::chrono::high_resolution_clock::now();
 		}
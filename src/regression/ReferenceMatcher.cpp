@@ -0,0 +1,183 @@
+#include "ReferenceMatcher.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+ReferenceMatcher::ReferenceMatcher(int maxDisparity) : maxDisparity(maxDisparity) {}
+
+void ReferenceMatcher::computeDisparity(const cv::Mat& left,
+    const cv::Mat& right,
+    cv::Mat& disparity,
+    const StereoMatcherParameters& parameters) const {
+    // same resolution and disparity range selection as StereoMatcher
+    int downscale = std::max(1, parameters.downscale);
+    int width = left.cols / downscale;
+    int height = left.rows / downscale;
+    int disparityRange = parameters.maxDisparity > 0 ? std::min(parameters.maxDisparity, maxDisparity) : maxDisparity;
+    disparityRange = std::max(1, disparityRange / downscale);
+
+    cv::Mat leftFrame = left;
+    cv::Mat rightFrame = right;
+    if (downscale > 1) {
+        cv::resize(left, leftFrame, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        cv::resize(right, rightFrame, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    }
+
+    cv::Mat costs;
+    computeSADCosts(leftFrame, rightFrame, costs, parameters.halfWindowSize, disparityRange);
+    if (parameters.aggregationPaths > 0) {
+        cv::Mat aggregatedCosts;
+        horizontalAggregation(costs, aggregatedCosts, disparityRange, (float)parameters.P1, (float)parameters.P2);
+        costs = aggregatedCosts;
+    }
+
+    if (downscale > 1) {
+        cv::Mat disparityScaled;
+        computeBestDisparity(costs, disparityScaled, disparityRange, parameters.uniquenessRatio);
+        cv::resize(disparityScaled, disparity, left.size(), 0, 0, cv::INTER_NEAREST);
+        disparity *= downscale;
+    }
+    else {
+        computeBestDisparity(costs, disparity, disparityRange, parameters.uniquenessRatio);
+    }
+}
+
+void ReferenceMatcher::computeSADCosts(const cv::Mat& left, const cv::Mat& right, cv::Mat& costs,
+    int halfWindowSize, int disparityRange) {
+    int width = left.cols;
+    int height = left.rows;
+    costs.create(height, width * disparityRange, CV_32F);
+    for (int y = 0; y < height; ++y) {
+        float* row = costs.ptr<float>(y);
+        for (int x = 0; x < width; ++x) {
+            for (int d = 0; d < disparityRange; ++d) {
+                int rightX = x - d;
+                if (rightX < 0) {
+                    row[x * disparityRange + d] = FLT_MAX;
+                    continue;
+                }
+                float sad = 0.0f;
+                for (int dy = -halfWindowSize; dy <= halfWindowSize; ++dy) {
+                    int windowY = std::clamp(y + dy, 0, height - 1);
+                    for (int dx = -halfWindowSize; dx <= halfWindowSize; ++dx) {
+                        int leftX = std::clamp(x + dx, 0, width - 1);
+                        int windowRightX = std::clamp(rightX + dx, 0, width - 1);
+                        int leftPixel = left.at<uchar>(windowY, leftX);
+                        int rightPixel = right.at<uchar>(windowY, windowRightX);
+                        sad += std::fabs((float)(leftPixel - rightPixel));
+                    }
+                }
+                row[x * disparityRange + d] = sad;
+            }
+        }
+    }
+}
+
+void ReferenceMatcher::horizontalAggregation(const cv::Mat& costs, cv::Mat& aggregatedCosts,
+    int disparityRange, float P1, float P2) {
+    int width = costs.cols / disparityRange;
+    int height = costs.rows;
+    aggregatedCosts.create(costs.size(), CV_32F);
+    std::vector<float> previous(disparityRange);
+    for (int y = 0; y < height; ++y) {
+        const float* costRow = costs.ptr<float>(y);
+        float* aggregatedRow = aggregatedCosts.ptr<float>(y);
+        // virtual zero column before the first pixel
+        std::fill(previous.begin(), previous.end(), 0.0f);
+        float minCostPrevX = 0.0f;
+        for (int x = 0; x < width; ++x) {
+            float minCostCurrX = FLT_MAX;
+            for (int d = 0; d < disparityRange; ++d) {
+                float currCost = costRow[x * disparityRange + d];
+                float minCost = previous[d];
+                if (d > 0) {
+                    minCost = std::fmin(minCost, previous[d - 1] + P1);
+                }
+                if (d < disparityRange - 1) {
+                    minCost = std::fmin(minCost, previous[d + 1] + P1);
+                }
+                minCost = std::fmin(minCost, P2);
+                minCost = minCost + currCost - minCostPrevX;
+                aggregatedRow[x * disparityRange + d] = minCost;
+                minCostCurrX = std::fmin(minCostCurrX, minCost);
+            }
+            std::copy(aggregatedRow + x * disparityRange, aggregatedRow + (x + 1) * disparityRange, previous.begin());
+            minCostPrevX = minCostCurrX;
+        }
+    }
+}
+
+void ReferenceMatcher::computeBestDisparity(const cv::Mat& costs, cv::Mat& disparity,
+    int disparityRange, float uniquenessRatio) {
+    int width = costs.cols / disparityRange;
+    int height = costs.rows;
+    disparity.create(height, width, CV_16U);
+    for (int y = 0; y < height; ++y) {
+        const float* costRow = costs.ptr<float>(y);
+        for (int x = 0; x < width; ++x) {
+            const float* cost = costRow + x * disparityRange;
+
+            float minCost = FLT_MAX;
+            int bestDisparity = -1;
+            for (int d = 0; d < disparityRange; ++d) {
+                if (cost[d] < minCost) {
+                    minCost = cost[d];
+                    bestDisparity = d;
+                }
+            }
+            for (int d = 0; d < disparityRange; ++d) {
+                if ((minCost > cost[d] * uniquenessRatio) && (std::abs(bestDisparity - d) > 1)) {
+                    bestDisparity = INVALID_DISP;
+                }
+            }
+
+            if (bestDisparity > 0 && bestDisparity < disparityRange - 1) {
+                float c0 = cost[bestDisparity - 1];
+                float c1 = cost[bestDisparity];
+                float c2 = cost[bestDisparity + 1];
+                float w0 = 1.0f / (std::fabs(c1 - c0) + 1.0f);
+                float w2 = 1.0f / (std::fabs(c1 - c2) + 1.0f);
+                float subpixelOffset = (w2 - w0) / (w0 + w2);
+                bestDisparity = (int)((float)(bestDisparity * DISP_SCALE) + subpixelOffset * DISP_SCALE);
+            }
+            else {
+                bestDisparity = INVALID_DISP;
+            }
+            disparity.at<ushort>(y, x) = (ushort)bestDisparity;
+        }
+    }
+}
+
+void ReferenceMatcher::computeSAD(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity,
+    int maxDisparity, int windowSize) {
+    int width = left.cols;
+    int height = left.rows;
+    disparity.create(height, width, CV_16U);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int minSAD = INT_MAX;
+            int bestDisparity = 0;
+            for (int d = 0; d < maxDisparity; d++) {
+                int sad = 0;
+                for (int dx = -windowSize; dx <= windowSize; dx++) {
+                    for (int dy = -windowSize; dy <= windowSize; dy++) {
+                        int leftX = x + dx;
+                        int leftY = y + dy;
+                        int rightX = leftX - d;
+                        if (leftX >= 0 && leftX < width && leftY >= 0 && leftY < height && rightX >= 0 && rightX < width) {
+                            sad += std::abs(left.at<uchar>(leftY, leftX) - right.at<uchar>(leftY, rightX));
+                        }
+                    }
+                }
+                if (sad < minSAD) {
+                    minSAD = sad;
+                    bestDisparity = d;
+                }
+            }
+            disparity.at<ushort>(y, x) = (ushort)(bestDisparity * DISP_SCALE);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include "../StereoMatcher.h"
+
+// Disparity encoding of the output maps, must match kernels.cl
+static const int DISP_SCALE = 16;
+static const int INVALID_DISP = 0;
+
+// Plain C++ implementation of the matching pipeline of kernels.cl (SAD costs,
+// horizontal SGM aggregation, best disparity with the uniqueness test and the
+// subpixel refinement), following the same rules and the same order of
+// floating point operations. Used as ground truth for the OpenCL backends.
+class ReferenceMatcher {
+public:
+    ReferenceMatcher(int maxDisparity = 64);
+
+    // Same inputs, parameters and output encoding as StereoMatcher::computeDisparity
+    void computeDisparity(const cv::Mat& left,
+        const cv::Mat& right,
+        cv::Mat& disparity,
+        const StereoMatcherParameters& parameters) const;
+
+    // Stages, on CV_32F cost volumes stored as (height, width * disparityRange)
+    static void computeSADCosts(const cv::Mat& left, const cv::Mat& right, cv::Mat& costs,
+        int halfWindowSize, int disparityRange);
+    static void horizontalAggregation(const cv::Mat& costs, cv::Mat& aggregatedCosts,
+        int disparityRange, float P1, float P2);
+    static void computeBestDisparity(const cv::Mat& costs, cv::Mat& disparity,
+        int disparityRange, float uniquenessRatio);
+
+    // Block matching of the computeSAD kernel (SADKernel): integer SAD over the
+    // window pixels inside both images, no uniqueness test nor subpixel
+    static void computeSAD(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity,
+        int maxDisparity, int windowSize);
+
+private:
+    int maxDisparity;
+};
@@ -0,0 +1,398 @@
+// Accuracy-vs-speed regression suite: matches synthetic stereo pairs with known
+// ground truth with every backend and mode, and compares them side by side
+// with the C++ reference implementation of the same rules. Backends:
+// - StereoMatcher, with direct launches, a replayed launch list and a command
+//   buffer, at every quality level of the LatencyGovernor, one after the other
+//   and then concurrently from one thread per stream
+// - SADKernel (computeSAD block matching), at full resolution
+// - reprojectDisparityTo3D, dense and compact, against the Q matrix applied on
+//   the host to the disparity map of the stream
+// Image sizes include widths which are not multiples of the aggregation tiles.
+//
+// Usage: AmeriaStereoRegression [--frames N] [--tolerance PERCENT]
+// Returns a non-zero code when a mode drifts from the reference by more than
+// the tolerance (percentage of pixels whose disparity differs).
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../OpenCLDeviceSelector.h"
+#include "../OpenCLManager.h"
+#include "../OpenCVHelper.h"
+#include "../StereoMatcher.h"
+#include "../cppkernels/SADKernel.h"
+#include "../LatencyGovernor.h"
+#include "ReferenceMatcher.h"
+#include "SyntheticStereo.h"
+
+struct BackendMode {
+    std::string name;
+    StereoStreamOptions options;
+};
+
+struct Accuracy {
+    double badPixelRate = 0.0;   // valid estimates more than 1 pixel away from the ground truth
+    double invalidRatio = 0.0;   // visible pixels without estimate
+};
+
+// Compared on the pixels of the left image which are visible in the right image
+static Accuracy evaluate(const cv::Mat& disparity, const SyntheticStereoPair& pair) {
+    int visible = 0;
+    int valid = 0;
+    int bad = 0;
+    for (int y = 0; y < disparity.rows; ++y) {
+        for (int x = 0; x < disparity.cols; ++x) {
+            if (!pair.visible.at<uchar>(y, x)) continue;
+            visible++;
+            ushort d = disparity.at<ushort>(y, x);
+            if (d == INVALID_DISP) continue;
+            valid++;
+            if (std::abs(d / (float)DISP_SCALE - pair.disparity.at<float>(y, x)) > 1.0f) {
+                bad++;
+            }
+        }
+    }
+    Accuracy accuracy;
+    accuracy.badPixelRate = valid > 0 ? (double)bad / valid : 0.0;
+    accuracy.invalidRatio = visible > 0 ? 1.0 - (double)valid / visible : 0.0;
+    return accuracy;
+}
+
+// Pixels whose validity differs, or whose disparities differ by more than one
+// DISP_SCALE unit (the subpixel refinement divides, which is not correctly
+// rounded on every device)
+static double mismatchRate(const cv::Mat& disparity, const cv::Mat& reference) {
+    int mismatches = 0;
+    for (int y = 0; y < disparity.rows; ++y) {
+        for (int x = 0; x < disparity.cols; ++x) {
+            int d = disparity.at<ushort>(y, x);
+            int r = reference.at<ushort>(y, x);
+            if ((d == INVALID_DISP) != (r == INVALID_DISP) || std::abs(d - r) > 1) {
+                mismatches++;
+            }
+        }
+    }
+    return (double)mismatches / disparity.total();
+}
+
+static std::string describe(const QualityLevel& level) {
+    return "w" + std::to_string(2 * level.halfWindowSize + 1)
+        + " d" + std::to_string(level.maxDisparity)
+        + " /" + std::to_string(level.downscale)
+        + " p" + std::to_string(level.aggregationPaths);
+}
+
+// accuracy is null for backends without disparity output
+static void printRow(const std::string& scene, const std::string& level, const std::string& backend,
+    const Accuracy* accuracy, double mismatch, double ms, const std::string& status) {
+    std::cout << std::left << std::setw(28) << scene << std::setw(16) << level << std::setw(26) << backend
+        << std::right << std::fixed << std::setprecision(2);
+    if (accuracy) {
+        std::cout << std::setw(9) << accuracy->badPixelRate * 100.0
+            << std::setw(10) << accuracy->invalidRatio * 100.0;
+    }
+    else {
+        std::cout << std::setw(9) << "-" << std::setw(10) << "-";
+    }
+    std::cout << std::setw(11) << mismatch * 100.0
+        << std::setw(10) << ms
+        << "  " << status << std::endl;
+}
+
+// SADKernel with its own buffers, for one image size
+class SADBackend {
+public:
+    SADBackend(OpenCLManager& manager, cv::Size size) : manager(manager), kernel(manager), size(size) {
+        size_t pixels = size.area();
+        leftBuffer = createOpenCLBuffer(pixels, CL_MEM_READ_ONLY, manager.getContext());
+        rightBuffer = createOpenCLBuffer(pixels, CL_MEM_READ_ONLY, manager.getContext());
+        disparityBuffer = createOpenCLBuffer(pixels * sizeof(cl_ushort), CL_MEM_READ_WRITE, manager.getContext());
+    }
+
+    ~SADBackend() {
+        for (cl_mem buffer : { leftBuffer, rightBuffer, disparityBuffer }) {
+            if (buffer) clReleaseMemObject(buffer);
+        }
+    }
+
+    bool compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity, int maxDisparity, int windowSize) {
+        if (!leftBuffer || !rightBuffer || !disparityBuffer) return false;
+        cl_command_queue queue = manager.getCommandQueue();
+        cl_int err = clEnqueueWriteBuffer(queue, leftBuffer, CL_FALSE, 0, left.total(), left.data, 0, nullptr, nullptr);
+        err |= clEnqueueWriteBuffer(queue, rightBuffer, CL_FALSE, 0, right.total(), right.data, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS
+            || !kernel.setArguments(leftBuffer, rightBuffer, disparityBuffer, size.width, size.height, maxDisparity, windowSize)
+            || !kernel.runKernel(size.area())) {
+            clFinish(queue);
+            return false;
+        }
+        disparity.create(size, CV_16U);
+        return fillMatFromOpenCLBuffer(disparity, disparityBuffer, manager.getContext(), queue);
+    }
+
+private:
+    OpenCLManager& manager;
+    SADKernel kernel;
+    cv::Size size;
+    cl_mem leftBuffer = nullptr;
+    cl_mem rightBuffer = nullptr;
+    cl_mem disparityBuffer = nullptr;
+};
+
+// Compares the reprojection of the last disparity map of a stream, dense and
+// compact, with Q applied on the host. disparity is the full resolution map
+// returned by the stream, matched at 1/downscale of its resolution. Returns
+// the fraction of mismatching points, or a negative value on error.
+static double reprojectionMismatchRate(StereoMatcher& matcher, int streamId, const cv::Matx44d& Q,
+    const cv::Mat& left, const cv::Mat& disparity, int downscale) {
+    cv::Mat dense;
+    cv::Mat compact;
+    if (!matcher.computePointCloud(streamId, Q, dense, false) || !matcher.computePointCloud(streamId, Q, compact, true)) {
+        return -1.0;
+    }
+
+    cv::Mat intensity = left;
+    if (downscale > 1) {
+        cv::resize(left, intensity, dense.size(), 0, 0, cv::INTER_AREA);
+    }
+
+    int mismatches = 0;
+    int validPoints = 0;
+    for (int y = 0; y < dense.rows; ++y) {
+        for (int x = 0; x < dense.cols; ++x) {
+            // the full resolution map is a nearest neighbor upsampling of the matched one
+            int fullX = x * downscale;
+            int fullY = y * downscale;
+            ushort value = disparity.at<ushort>(fullY, fullX);
+            cv::Vec4d point = Q * cv::Vec4d(fullX, fullY, value / (double)DISP_SCALE, 1.0);
+            bool valid = value != INVALID_DISP && point[3] != 0.0;
+
+            const cv::Vec4f& result = dense.at<cv::Vec4f>(y, x);
+            bool resultValid = !std::isnan(result[0]);
+            if (valid != resultValid) {
+                mismatches++;
+                continue;
+            }
+            if (!valid) continue;
+            validPoints++;
+            for (int i = 0; i < 3; ++i) {
+                double expected = point[i] / point[3];
+                if (std::abs(result[i] - expected) > 1e-3 * std::max(1.0, std::abs(expected))) {
+                    mismatches++;
+                    break;
+                }
+            }
+            if (result[3] != intensity.at<uchar>(y, x)) {
+                mismatches++;
+            }
+        }
+    }
+    // compact mode packs exactly the valid points, in any order
+    mismatches += std::abs(compact.rows - validPoints);
+    return (double)mismatches / dense.total();
+}
+
+int main(int argc, char** argv)
+{
+    int frames = 10;
+    double tolerance = 0.5;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string argument = argv[i];
+        if (argument == "--frames") {
+            frames = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (argument == "--tolerance") {
+            tolerance = std::atof(argv[i + 1]);
+        }
+        else {
+            std::cerr << "Unknown argument: " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    OpenCLDeviceSelector selector;
+    if (!selector.selectBestDevice()) {
+        std::cerr << "Failed to select OpenCL device!" << std::endl;
+        return 1;
+    }
+    selector.printDeviceInfo();
+
+    OpenCLManager manager;
+    if (!manager.initialize()) {
+        std::cerr << "Failed to initialize OpenCL manager!" << std::endl;
+        return 1;
+    }
+
+    StereoMatcher matcher(manager);
+    if (!matcher.initialize("kernels.cl")) {
+        std::cerr << "Failed to initialize stereo matcher!" << std::endl;
+        return 1;
+    }
+
+    // 300 and its downscaled width 150 are not multiples of the aggregation
+    // tiles (32 pixels), so that partial tiles are covered
+    const int maxDisparity = 64;
+    std::vector<cv::Size> sizes = { cv::Size(320, 256), cv::Size(300, 200) };
+    std::vector<QualityLevel> levels = LatencyGovernor::defaultLevels();
+
+    std::vector<BackendMode> modes(3);
+    modes[0].name = "direct";
+    modes[0].options.commandReplay = false;
+    modes[1].name = "replay (launch list)";
+    modes[1].options.commandBuffer = false;
+    modes[2].name = "replay (command buffer)";
+    for (BackendMode& mode : modes) {
+        mode.options.maxDisparity = maxDisparity;
+    }
+
+    std::cout << std::left << std::setw(28) << "scene" << std::setw(16) << "level" << std::setw(26) << "backend"
+        << std::right << std::setw(9) << "bad %" << std::setw(10) << "invalid %" << std::setw(11) << "vs ref %"
+        << std::setw(10) << "ms" << std::endl;
+
+    ReferenceMatcher reference(maxDisparity);
+    int failures = 0;
+    auto check = [&](const std::string& scene, const std::string& level, const std::string& backend,
+        const Accuracy* accuracy, double mismatch, double ms) {
+        if (mismatch < 0.0) {
+            printRow(scene, level, backend, nullptr, 1.0, 0.0, "FAILED (error)");
+            failures++;
+            return;
+        }
+        bool drift = mismatch * 100.0 > tolerance;
+        failures += drift ? 1 : 0;
+        printRow(scene, level, backend, accuracy, mismatch, ms, drift ? "FAILED (drift)" : "ok");
+    };
+
+    for (const cv::Size& size : sizes) {
+        std::vector<int> streams;
+        for (const BackendMode& mode : modes) {
+            int streamId = matcher.createStream(size.width, size.height, mode.options);
+            if (streamId < 0) {
+                std::cerr << "Failed to create stereo stream for " << mode.name << std::endl;
+                return 1;
+            }
+            streams.push_back(streamId);
+        }
+        SADBackend sadBackend(manager, size);
+
+        // placeholder calibration, cv::stereoRectify convention
+        cv::Matx44d Q(
+            1, 0, 0, -size.width / 2.0,
+            0, 1, 0, -size.height / 2.0,
+            0, 0, 0, 500.0,
+            0, 0, 1.0 / 0.1, 0);
+
+        for (const SyntheticStereoPair& pair : SyntheticStereo::createScenes(size)) {
+            std::string scene = pair.name + " " + std::to_string(size.width) + "x" + std::to_string(size.height);
+            for (const QualityLevel& level : levels) {
+                StereoMatcherParameters parameters;
+                parameters.halfWindowSize = level.halfWindowSize;
+                parameters.maxDisparity = level.maxDisparity;
+                parameters.downscale = level.downscale;
+                parameters.aggregationPaths = level.aggregationPaths;
+
+                cv::Mat referenceDisparity;
+                auto start = std::chrono::high_resolution_clock::now();
+                reference.computeDisparity(pair.left, pair.right, referenceDisparity, parameters);
+                double referenceMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                Accuracy referenceAccuracy = evaluate(referenceDisparity, pair);
+                printRow(scene, describe(level), "reference (C++)", &referenceAccuracy, 0.0, referenceMs, "");
+
+                std::vector<cv::Mat> serialDisparities(modes.size());
+                for (size_t i = 0; i < modes.size(); ++i) {
+                    cv::Mat disparity;
+                    StereoFrameTimings timings;
+                    double totalMs = 0.0;
+                    bool success = true;
+                    // first frame records the launches and is not timed
+                    for (int frame = 0; frame <= frames && success; ++frame) {
+                        success = matcher.computeDisparity(streams[i], pair.left, pair.right, disparity, parameters, &timings);
+                        if (frame > 0) totalMs += timings.totalMs;
+                    }
+
+                    std::string name = modes[i].name;
+                    if (modes[i].options.commandBuffer && modes[i].options.commandReplay && !matcher.isUsingCommandBuffer(streams[i])) {
+                        name = "replay (unsupported)";
+                    }
+                    if (!success) {
+                        check(scene, describe(level), name, nullptr, -1.0, 0.0);
+                        continue;
+                    }
+                    serialDisparities[i] = disparity.clone();
+                    Accuracy accuracy = evaluate(disparity, pair);
+                    check(scene, describe(level), name, &accuracy, mismatchRate(disparity, referenceDisparity), totalMs / frames);
+
+                    // the stream still holds this disparity map on the device
+                    if (i == 0) {
+                        start = std::chrono::high_resolution_clock::now();
+                        double mismatch = reprojectionMismatchRate(matcher, streams[i], Q, pair.left, disparity, level.downscale);
+                        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                        check(scene, describe(level), "reprojection 3D", nullptr, mismatch, ms);
+                    }
+                }
+
+                // all the streams at once, from one thread each: the results must
+                // be identical to the serial ones
+                bool serialSuccess = std::none_of(serialDisparities.begin(), serialDisparities.end(),
+                    [](const cv::Mat& disparity) { return disparity.empty(); });
+                if (serialSuccess) {
+                    std::vector<cv::Mat> concurrentDisparities(modes.size());
+                    std::vector<char> concurrentSuccess(modes.size(), 0);
+                    std::vector<std::thread> threads;
+                    start = std::chrono::high_resolution_clock::now();
+                    for (size_t i = 0; i < modes.size(); ++i) {
+                        threads.emplace_back([&, i]() {
+                            concurrentSuccess[i] = matcher.computeDisparity(streams[i], pair.left, pair.right, concurrentDisparities[i], parameters);
+                        });
+                    }
+                    for (std::thread& thread : threads) {
+                        thread.join();
+                    }
+                    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+                    std::string name = "concurrent streams (" + std::to_string(modes.size()) + ")";
+                    if (std::count(concurrentSuccess.begin(), concurrentSuccess.end(), 0) > 0) {
+                        check(scene, describe(level), name, nullptr, -1.0, 0.0);
+                    }
+                    else {
+                        int differing = 0;
+                        for (size_t i = 0; i < modes.size(); ++i) {
+                            differing += cv::countNonZero(concurrentDisparities[i] != serialDisparities[i]);
+                        }
+                        bool differs = differing > 0;
+                        failures += differs ? 1 : 0;
+                        printRow(scene, describe(level), name, nullptr,
+                            (double)differing / (pair.left.total() * modes.size()), ms, differs ? "FAILED (differs)" : "ok");
+                    }
+                }
+
+                // block matching only runs at full resolution
+                if (level.downscale == 1) {
+                    cv::Mat sadReference;
+                    ReferenceMatcher::computeSAD(pair.left, pair.right, sadReference, level.maxDisparity, level.halfWindowSize);
+                    cv::Mat disparity;
+                    start = std::chrono::high_resolution_clock::now();
+                    bool success = sadBackend.compute(pair.left, pair.right, disparity, level.maxDisparity, level.halfWindowSize);
+                    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                    Accuracy accuracy = success ? evaluate(disparity, pair) : Accuracy();
+                    check(scene, describe(level), "SADKernel", &accuracy, success ? mismatchRate(disparity, sadReference) : -1.0, ms);
+                }
+            }
+        }
+    }
+
+    if (failures > 0) {
+        std::cout << failures << " mode(s) drifted beyond " << tolerance << "% from the reference" << std::endl;
+        return 1;
+    }
+    std::cout << "All modes within " << tolerance << "% of the reference" << std::endl;
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "SyntheticStereo.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+
+// Random texture with some low frequency content, so that the matching
+// windows are neither flat nor pure noise
+static cv::Mat createTexture(cv::Size size, cv::RNG& rng) {
+    cv::Mat noise(size, CV_32F);
+    rng.fill(noise, cv::RNG::UNIFORM, 0.0, 255.0);
+    cv::Mat coarse;
+    cv::GaussianBlur(noise, coarse, cv::Size(0, 0), 4.0);
+    cv::Mat fine;
+    cv::GaussianBlur(noise, fine, cv::Size(0, 0), 0.8);
+    cv::Mat texture = 0.5 * fine + 0.5 * coarse;
+    cv::normalize(texture, texture, 20.0, 235.0, cv::NORM_MINMAX);
+    return texture;
+}
+
+// Bilinear sample of a layer texture, in left image coordinates
+static float sampleTexture(const cv::Mat& texture, double x, int y) {
+    x = std::min(std::max(x, 0.0), (double)texture.cols - 1.001);
+    int x0 = (int)x;
+    float t = (float)(x - x0);
+    const float* row = texture.ptr<float>(y);
+    return row[x0] * (1.0f - t) + row[x0 + 1] * t;
+}
+
+static double layerDisparity(const SyntheticLayer& layer, double x, int y) {
+    return layer.a * x + layer.b * y + layer.c;
+}
+
+SyntheticStereoPair SyntheticStereo::render(const std::string& name, cv::Size size,
+    const std::vector<SyntheticLayer>& layers, unsigned int seed) {
+    cv::RNG rng(seed);
+    std::vector<cv::Mat> textures;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        textures.push_back(createTexture(size, rng));
+    }
+
+    SyntheticStereoPair pair;
+    pair.name = name;
+    pair.left.create(size, CV_8UC1);
+    pair.right.create(size, CV_8UC1);
+    pair.disparity.create(size, CV_32F);
+    pair.visible.create(size, CV_8U);
+
+    // Left image: front-most layer at each pixel
+    std::vector<int> leftLayer(size.area(), -1);
+    for (int y = 0; y < size.height; ++y) {
+        for (int x = 0; x < size.width; ++x) {
+            int front = -1;
+            double frontDisparity = -1.0;
+            for (int i = 0; i < (int)layers.size(); ++i) {
+                double d = layerDisparity(layers[i], x, y);
+                if (layers[i].area.contains(cv::Point(x, y)) && d > frontDisparity) {
+                    front = i;
+                    frontDisparity = d;
+                }
+            }
+            leftLayer[y * size.width + x] = front;
+            pair.left.at<uchar>(y, x) = front >= 0 ? cv::saturate_cast<uchar>(textures[front].at<float>(y, x)) : 0;
+            pair.disparity.at<float>(y, x) = front >= 0 ? (float)frontDisparity : 0.0f;
+        }
+    }
+
+    // Right image: the point of layer i seen at right pixel xr comes from the
+    // left pixel x = xr + d(x, y), i.e. x = (xr + b * y + c) / (1 - a)
+    std::vector<int> rightLayer(size.area(), -1);
+    for (int y = 0; y < size.height; ++y) {
+        for (int xr = 0; xr < size.width; ++xr) {
+            int front = -1;
+            double frontDisparity = -1.0;
+            double frontX = 0.0;
+            for (int i = 0; i < (int)layers.size(); ++i) {
+                const SyntheticLayer& layer = layers[i];
+                double x = (xr + layer.b * y + layer.c) / (1.0 - layer.a);
+                double d = layerDisparity(layer, x, y);
+                bool covered = x >= layer.area.x && x < layer.area.x + layer.area.width
+                    && y >= layer.area.y && y < layer.area.y + layer.area.height;
+                if (covered && d > frontDisparity) {
+                    front = i;
+                    frontDisparity = d;
+                    frontX = x;
+                }
+            }
+            rightLayer[y * size.width + xr] = front;
+            pair.right.at<uchar>(y, xr) = front >= 0 ? cv::saturate_cast<uchar>(sampleTexture(textures[front], frontX, y)) : 0;
+        }
+    }
+
+    // A left pixel is visible if its layer is also the front-most one where it
+    // lands in the right image
+    for (int y = 0; y < size.height; ++y) {
+        for (int x = 0; x < size.width; ++x) {
+            int layer = leftLayer[y * size.width + x];
+            int xr = (int)std::lround(x - pair.disparity.at<float>(y, x));
+            bool visible = layer >= 0 && xr >= 0 && xr < size.width && rightLayer[y * size.width + xr] == layer;
+            pair.visible.at<uchar>(y, x) = visible ? 255 : 0;
+        }
+    }
+    return pair;
+}
+
+std::vector<SyntheticStereoPair> SyntheticStereo::createScenes(cv::Size size) {
+    int w = size.width;
+    int h = size.height;
+    cv::Rect full(0, 0, w, h);
+    std::vector<SyntheticStereoPair> scenes;
+
+    // a, b, c, area
+    scenes.push_back(render("planes", size, {
+        { 0.0, 0.0, 8.0, full },
+        { 0.0, 0.0, 20.0, cv::Rect(w / 4, h / 4, w / 3, h / 2) },
+        { 0.0, 0.0, 36.0, cv::Rect(w * 5 / 8, h / 3, w / 5, h / 3) },
+    }, 1));
+
+    scenes.push_back(render("slanted", size, {
+        { 24.0 / w, 0.0, 6.0, full },
+        { 0.0, 12.0 / h, 28.0, cv::Rect(w / 3, h / 5, w / 3, h * 3 / 5) },
+    }, 2));
+
+    scenes.push_back(render("slanted-occluders", size, {
+        { 0.0, 16.0 / h, 10.0, full },
+        { -12.0 / w, 0.0, 34.0, cv::Rect(w / 8, h / 6, w / 4, h / 3) },
+        { 0.0, 0.0, 44.0, cv::Rect(w / 2, h / 2, w / 4, h / 3) },
+    }, 3));
+    return scenes;
+}
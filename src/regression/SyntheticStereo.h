@@ -0,0 +1,33 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+// Rectified stereo pair rendered from textured planar layers, with its ground truth
+struct SyntheticStereoPair {
+    std::string name;
+    cv::Mat left;           // CV_8UC1
+    cv::Mat right;          // CV_8UC1
+    cv::Mat disparity;      // CV_32F, left image disparity in pixels
+    cv::Mat visible;        // CV_8U, 255 where the left pixel is visible in the right image
+};
+
+// Textured plane of disparity d(x, y) = a * x + b * y + c, x and y being left
+// image coordinates, covering the given rectangle of the left image
+struct SyntheticLayer {
+    double a;
+    double b;
+    double c;
+    cv::Rect area;
+};
+
+class SyntheticStereo {
+public:
+    // Renders the layers, the one with the largest disparity being in front
+    static SyntheticStereoPair render(const std::string& name, cv::Size size,
+        const std::vector<SyntheticLayer>& layers, unsigned int seed);
+
+    // Fronto-parallel and slanted planes with occlusions, for the given size
+    static std::vector<SyntheticStereoPair> createScenes(cv::Size size);
+};